@@ -41,6 +41,34 @@ input_getc (void)
   return key;
 }
 
+/* Retrieves up to SIZE keys from the input buffer into BUF, all
+   that are waiting, and returns the number retrieved, which is 0
+   if none are.  Does not wait.  BUF must not page fault. */
+size_t
+input_getbuf (uint8_t *buf, size_t size) 
+{
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  cnt = intq_getbuf (&buffer, buf, size);
+  serial_notify ();
+  intr_set_level (old_level);
+
+  return cnt;
+}
+
+/* Waits until at least one key is in the input buffer. */
+void
+input_wait (void) 
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  intq_wait_nonempty (&buffer);
+  intr_set_level (old_level);
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
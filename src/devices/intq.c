@@ -54,6 +54,40 @@ intq_getc (struct intq *q)
   return byte;
 }
 
+/* Sleeps until Q is not empty.  Must not be called from an
+   interrupt handler. */
+void
+intq_wait_nonempty (struct intq *q) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_context ());
+  while (intq_empty (q)) 
+    {
+      lock_acquire (&q->lock);
+      wait (q, &q->not_empty);
+      lock_release (&q->lock);
+    }
+}
+
+/* Removes up to SIZE bytes from Q into BUF, as many as Q holds,
+   and returns the number removed, which is 0 if Q is empty.
+   Does not sleep. */
+size_t
+intq_getbuf (struct intq *q, uint8_t *buf, size_t size)
+{
+  size_t cnt = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (cnt < size && !intq_empty (q))
+    {
+      buf[cnt++] = q->buf[q->tail];
+      q->tail = next (q->tail);
+    }
+  signal (q, &q->not_full);
+  return cnt;
+}
+
 /* Adds BYTE to the end of Q.
    If Q is full, sleeps until a byte is removed.
    When called from an interrupt handler, Q must not be full. */
@@ -0,0 +1,380 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors the cache holds. */
+#define CACHE_SIZE 64
+
+/* Ticks between write-behind flushes of dirty sectors. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* Most read-ahead requests queued at once.  Later requests are
+   dropped until the queue drains. */
+#define READAHEAD_MAX 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if in_use. */
+    bool in_use;                /* Assigned to a sector? */
+    bool valid;                 /* Data read in (or fully written)? */
+    bool dirty;                 /* Data newer than the disk's? */
+    bool accessed;              /* Used since the clock last passed? */
+    struct lock lock;           /* Held while using or filling data. */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Guards the sector assignment of every entry and the clock
+   hand.  May be held while trying, but never while waiting, for
+   an entry's lock. */
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Sectors waiting to be read ahead. */
+struct readahead
+  {
+    block_sector_t sector;
+    struct list_elem elem;
+  };
+static struct list readahead_list;
+static size_t readahead_cnt;
+static struct lock readahead_lock;
+static struct semaphore readahead_sema;
+
+/* Statistics. */
+static unsigned long long hit_cnt;          /* Lookups found in cache. */
+static unsigned long long miss_cnt;         /* Lookups read from disk. */
+static unsigned long long readahead_done;   /* Sectors loaded by read-ahead. */
+static unsigned long long write_back_cnt;   /* Dirty sectors written. */
+
+static struct cache_entry *cache_get (block_sector_t, bool load, bool demand);
+static struct cache_entry *cache_find (block_sector_t);
+static void write_back (struct cache_entry *);
+static void flusher (void *aux);
+static void reader (void *aux);
+
+/* Initializes the buffer cache and starts its write-behind and
+   read-ahead threads. */
+void
+cache_init (void) 
+{
+  size_t pages = DIV_ROUND_UP (CACHE_SIZE * BLOCK_SECTOR_SIZE, PGSIZE);
+  uint8_t *base = palloc_get_multiple (PAL_ASSERT, pages);
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].in_use = false;
+      lock_init (&cache[i].lock);
+      cache[i].data = base + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  list_init (&readahead_list);
+  lock_init (&readahead_lock);
+  sema_init (&readahead_sema, 0);
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create ("readahead", PRI_DEFAULT, reader, NULL);
+}
+
+/* Writes every dirty cached sector to disk. */
+void
+cache_flush (void) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      lock_acquire (&cache[i].lock);
+      write_back (&cache[i]);
+      lock_release (&cache[i].lock);
+    }
+}
+
+/* Reads SECTOR into BUFFER, which must hold BLOCK_SECTOR_SIZE
+   bytes. */
+void
+cache_read (block_sector_t sector, void *buffer) 
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, true, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to SECTOR.  The
+   write reaches the disk later, in the background. */
+void
+cache_write (block_sector_t sector, const void *buffer) 
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER to SECTOR starting at byte OFS.
+   The sector is only read from disk if the write covers part of
+   it. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size) 
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE, true);
+  memcpy (e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  lock_release (&e->lock);
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background, in anticipation of a read. */
+void
+cache_readahead (block_sector_t sector) 
+{
+  struct readahead *ra = malloc (sizeof *ra);
+
+  if (ra == NULL)
+    return;
+  ra->sector = sector;
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt >= READAHEAD_MAX)
+    {
+      lock_release (&readahead_lock);
+      free (ra);
+      return;
+    }
+  list_push_back (&readahead_list, &ra->elem);
+  readahead_cnt++;
+  lock_release (&readahead_lock);
+  sema_up (&readahead_sema);
+}
+
+/* Writes any dirty cached copies of the CNT sectors starting at
+   SECTOR to disk, so that the disk can be read directly. */
+void
+cache_sync (block_sector_t sector, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      /* A dirty entry cannot change sectors without being
+         written, so entries that do not look like a match can be
+         skipped without taking their locks. */
+      if (!e->in_use || e->sector - sector >= cnt)
+        continue;
+      lock_acquire (&e->lock);
+      if (e->in_use && e->sector - sector < cnt)
+        write_back (e);
+      lock_release (&e->lock);
+    }
+}
+
+/* Discards any cached copies of the CNT sectors starting at
+   SECTOR without writing them, because the sectors have been
+   freed. */
+void
+cache_invalidate (block_sector_t sector, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      lock_acquire (&e->lock);
+      lock_acquire (&cache_lock);
+      if (e->in_use && e->sector - sector < cnt)
+        e->in_use = false;
+      lock_release (&cache_lock);
+      lock_release (&e->lock);
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void) 
+{
+  printf ("Buffer cache: %llu hits, %llu misses, %llu read ahead, "
+          "%llu writes\n",
+          hit_cnt, miss_cnt, readahead_done, write_back_cnt);
+}
+
+/* Returns the entry for SECTOR with its lock held.  If the
+   sector is not cached, an entry is taken over from the sector
+   the clock algorithm picks, and filled from disk if LOAD is
+   true.  DEMAND is false for read-ahead, which is counted apart
+   from the hits and misses of actual accesses. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load, bool demand) 
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+      size_t scanned;
+
+      lock_acquire (&cache_lock);
+      e = cache_find (sector);
+      if (e != NULL)
+        {
+          if (demand)
+            hit_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (e->in_use && e->sector == sector)
+            {
+              e->accessed = true;
+              if (!e->valid && load)
+                {
+                  block_read (fs_device, sector, e->data);
+                  e->valid = true;
+                }
+              return e;
+            }
+          /* Taken over while we waited. */
+          lock_release (&e->lock);
+          continue;
+        }
+
+      /* Pick a victim: skip busy entries, and give recently used
+         ones a second chance. */
+      for (scanned = 0; scanned < 2 * CACHE_SIZE; scanned++)
+        {
+          e = &cache[clock_hand];
+          clock_hand = (clock_hand + 1) % CACHE_SIZE;
+          if (!lock_try_acquire (&e->lock))
+            continue;
+          if (e->in_use && e->accessed)
+            {
+              e->accessed = false;
+              lock_release (&e->lock);
+              continue;
+            }
+          break;
+        }
+      if (scanned == 2 * CACHE_SIZE)
+        {
+          /* Every entry is busy.  Wait for the one under the clock
+             hand, blocking on its lock so that its holder gets our
+             priority, rather than yielding to threads that may
+             never let the holder run. */
+          e = &cache[clock_hand];
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          lock_release (&e->lock);
+          continue;
+        }
+
+      if (e->in_use && e->dirty)
+        {
+          /* Write the old sector out first, still under its own
+             number so that readers of it wait for us, then look
+             again. */
+          lock_release (&cache_lock);
+          write_back (e);
+          lock_release (&e->lock);
+          continue;
+        }
+
+      if (demand)
+        miss_cnt++;
+      else
+        readahead_done++;
+      e->sector = sector;
+      e->in_use = true;
+      e->valid = false;
+      e->dirty = false;
+      e->accessed = true;
+      lock_release (&cache_lock);
+      if (load)
+        {
+          block_read (fs_device, sector, e->data);
+          e->valid = true;
+        }
+      return e;
+    }
+}
+
+/* Returns the entry assigned to SECTOR, or a null pointer.
+   cache_lock must be held. */
+static struct cache_entry *
+cache_find (block_sector_t sector) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Writes E to disk if it is dirty.  E's lock must be held. */
+static void
+write_back (struct cache_entry *e) 
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+  if (e->in_use && e->valid && e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      write_back_cnt++;
+    }
+}
+
+/* Write-behind thread: flushes dirty sectors every
+   FLUSH_INTERVAL ticks, so that a crash loses little and
+   evictions seldom have to wait for a write. */
+static void
+flusher (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread: brings requested sectors into the cache. */
+static void
+reader (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      struct readahead *ra;
+      struct cache_entry *e;
+
+      sema_down (&readahead_sema);
+      lock_acquire (&readahead_lock);
+      ra = list_entry (list_pop_front (&readahead_list),
+                       struct readahead, elem);
+      readahead_cnt--;
+      lock_release (&readahead_lock);
+
+      e = cache_get (ra->sector, true, false);
+      lock_release (&e->lock);
+      free (ra);
+    }
+}
@@ -1,16 +1,36 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* In-memory index of a directory's entries, built when the
+   directory is first opened and shared by every `struct dir'
+   open on it, so that finding a name, or a free slot for one,
+   does not scan the directory.  Its lock serializes lookups and
+   changes in that directory only. */
+struct dir_index
+  {
+    block_sector_t sector;              /* Directory's inode sector. */
+    int open_cnt;                       /* Number of `struct dir's using it. */
+    struct lock lock;                   /* Guards the members below. */
+    bool broken;                        /* Building it ran out of memory. */
+    struct hash names;                  /* Entries in use, by name. */
+    struct list free_slots;             /* Offsets of unused entries. */
+    off_t end;                          /* Offset just past the last entry. */
+    struct hash_elem elem;              /* Element in `indexes'. */
+  };
 
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
     off_t pos;                          /* Current position. */
+    struct dir_index *index;            /* Index of its entries. */
   };
 
 /* A single directory entry. */
@@ -21,12 +41,86 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* An entry in a dir_index's `names'. */
+struct name_entry
+  {
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of the entry. */
+    struct hash_elem elem;              /* Element in `names'. */
+  };
+
+/* An unused entry in a dir_index's `free_slots'. */
+struct free_slot
+  {
+    off_t ofs;                          /* Offset of the entry. */
+    struct list_elem elem;              /* Element in `free_slots'. */
+  };
+
+/* Indexes of open directories, by inode sector. */
+static struct hash indexes;
+
+/* Guards `indexes' and each index's open_cnt.  Never held while
+   waiting for an index's lock or doing I/O. */
+static struct lock indexes_lock;
+
+static struct dir_index *index_get (struct inode *);
+static void index_put (struct dir_index *);
+static void index_destroy (struct dir_index *);
+static struct name_entry *index_find (const struct dir_index *,
+                                      const char *name);
+static bool index_add (struct dir_index *, const struct dir_entry *,
+                       off_t ofs);
+static bool index_free_slot (struct dir_index *, off_t ofs);
+static void name_entry_destroy (struct hash_elem *, void *);
+static unsigned index_hash (const struct hash_elem *, void *);
+static bool index_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static unsigned name_hash (const struct hash_elem *, void *);
+static bool name_less (const struct hash_elem *, const struct hash_elem *,
+                       void *);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  lock_init (&indexes_lock);
+  if (!hash_init (&indexes, index_hash, index_less, NULL))
+    PANIC ("directory index creation failed");
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory is in sector PARENT.
+   The root directory is its own parent.  Every directory begins
+   with "." and ".." entries, which dir_readdir() skips.  Room
+   for those is allocated with the inode, so that running out of
+   space is reported, and cleaned up, by inode_create().
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_entry e[2];
+
+  memset (e, 0, sizeof e);
+  e[0].inode_sector = sector;
+  strlcpy (e[0].name, ".", sizeof e[0].name);
+  e[0].in_use = true;
+  e[1].inode_sector = parent;
+  strlcpy (e[1].name, "..", sizeof e[1].name);
+  e[1].in_use = true;
+
+  if (entry_cnt < 2)
+    entry_cnt = 2;
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    return false;
+  else
+    {
+      struct inode *inode = inode_open (sector);
+      bool success = (inode != NULL
+                      && inode_write_at (inode, e, sizeof e, 0) == sizeof e);
+      inode_close (inode);
+      return success;
+    }
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -36,6 +130,8 @@ dir_open (struct inode *inode)
 {
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
+    dir->index = index_get (inode);
+  if (dir != NULL && dir->index != NULL)
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -71,6 +167,7 @@ dir_close (struct dir *dir)
 {
   if (dir != NULL)
     {
+      index_put (dir->index);
       inode_close (dir->inode);
       free (dir);
     }
@@ -83,51 +180,27 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
-static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
-{
-  struct dir_entry e;
-  size_t ofs;
-  
-  ASSERT (dir != NULL);
-  ASSERT (name != NULL);
-
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
-}
-
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   A directory that has been removed contains nothing, not even
+   "." and "..". */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  struct name_entry *n;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  *inode = NULL;
+  lock_acquire (&dir->index->lock);
+  if (!inode_is_removed (dir->inode)
+      && (n = index_find (dir->index, name)) != NULL)
+    *inode = inode_open (n->inode_sector);
+  lock_release (&dir->index->lock);
 
   return *inode != NULL;
 }
@@ -136,12 +209,13 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
+  struct dir_index *index;
   off_t ofs;
   bool success = false;
 
@@ -152,81 +226,142 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  index = dir->index;
+  lock_acquire (&index->lock);
+
+  /* Check that NAME is not in use, and that DIR still exists. */
+  if (index_find (index, name) != NULL || inode_is_removed (dir->inode))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+     current end-of-file. */
+  ofs = index->end;
+  if (!list_empty (&index->free_slots))
+    ofs = list_entry (list_front (&index->free_slots),
+                      struct free_slot, elem)->ofs;
+
+  /* Write slot, then index it. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+    goto done;
+  if (!index_add (index, &e, ofs))
+    {
+      /* Keep the disk in step with the index. */
+      e.in_use = false;
+      inode_write_at (dir->inode, &e, sizeof e, ofs);
+      goto done;
+    }
+  if (ofs == index->end)
+    index->end += sizeof e;
+  else
+    {
+      struct list_elem *slot = list_pop_front (&index->free_slots);
+      free (list_entry (slot, struct free_slot, elem));
+    }
+  success = true;
 
  done:
+  lock_release (&index->lock);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, NAME is "." or "..", or
+   NAME is a directory that is not empty.
+   Removing a directory holds DIR's index lock and then the
+   removed directory's.  Locks are only ever nested in that
+   order, from parent to child, so this cannot deadlock. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
+  struct name_entry *n;
   struct inode *inode = NULL;
+  struct dir_index *child = NULL;
   bool success = false;
-  off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
+  lock_acquire (&dir->index->lock);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  n = index_find (dir->index, name);
+  if (n == NULL)
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (n->inode_sector);
   if (inode == NULL)
     goto done;
 
+  /* A directory must hold nothing but "." and "..".  Its index
+     stays locked until it is marked removed, so that nothing can
+     be added to it meanwhile. */
+  if (inode_is_dir (inode))
+    {
+      child = index_get (inode);
+      if (child == NULL)
+        goto done;
+      lock_acquire (&child->lock);
+      if (hash_size (&child->names) > 2)
+        goto done;
+    }
+
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  memset (&e, 0, sizeof e);
+  if (inode_write_at (dir->inode, &e, sizeof e, n->ofs) != sizeof e
+      || !index_free_slot (dir->index, n->ofs))
     goto done;
+  hash_delete (&dir->index->names, &n->elem);
+  free (n);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (child != NULL)
+    {
+      lock_release (&child->lock);
+      index_put (child);
+    }
+  lock_release (&dir->index->lock);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  "." and ".." are not returned. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  return dir_readdir_at (dir->inode, &dir->pos, name);
+}
+
+/* Reads the directory entry at *POS, or the next one in use
+   after it, in the directory whose inode is INODE, stores its
+   name in NAME, and advances *POS past it.  Returns false if
+   there are no more entries.  Lets a directory opened as a file
+   be listed using the file's position, without an index. */
+bool
+dir_readdir_at (struct inode *inode, off_t *pos, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  while (inode_read_at (inode, &e, sizeof e, *pos) == sizeof e) 
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      *pos += sizeof e;
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
           return true;
@@ -234,3 +369,186 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Returns the index of the directory whose inode is INODE,
+   reading the directory to build it if no other `struct dir' has
+   it open, and takes a reference to it.  Returns a null pointer
+   if memory runs out.
+
+   A new index is entered in `indexes' before it is built, with
+   its lock held, so that the directory is read without holding
+   indexes_lock and other openers wait on the index's lock. */
+static struct dir_index *
+index_get (struct inode *inode)
+{
+  struct dir_index *index, key;
+  struct hash_elem *found;
+  struct dir_entry entries[16];
+  off_t ofs = 0, got;
+  bool broken;
+
+  key.sector = inode_get_inumber (inode);
+  lock_acquire (&indexes_lock);
+  found = hash_find (&indexes, &key.elem);
+  if (found != NULL)
+    {
+      index = hash_entry (found, struct dir_index, elem);
+      index->open_cnt++;
+      lock_release (&indexes_lock);
+
+      /* Wait for it to be built. */
+      lock_acquire (&index->lock);
+      broken = index->broken;
+      lock_release (&index->lock);
+      if (broken)
+        {
+          index_put (index);
+          return NULL;
+        }
+      return index;
+    }
+
+  index = malloc (sizeof *index);
+  if (index == NULL || !hash_init (&index->names, name_hash, name_less, NULL))
+    {
+      lock_release (&indexes_lock);
+      free (index);
+      return NULL; 
+    }
+  index->sector = key.sector;
+  index->open_cnt = 1;
+  lock_init (&index->lock);
+  index->broken = false;
+  list_init (&index->free_slots);
+  lock_acquire (&index->lock);
+  hash_insert (&indexes, &index->elem);
+  lock_release (&indexes_lock);
+
+  /* Read the entries in bunches. */
+  while (!index->broken
+         && (got = inode_read_at (inode, entries, sizeof entries, ofs))
+            >= (off_t) sizeof *entries)
+    {
+      size_t i, cnt = got / sizeof *entries;
+      for (i = 0; i < cnt && !index->broken; i++, ofs += sizeof *entries)
+        if (!(entries[i].in_use
+              ? index_add (index, &entries[i], ofs)
+              : index_free_slot (index, ofs)))
+          index->broken = true;
+    }
+  index->end = ofs;
+  broken = index->broken;
+  lock_release (&index->lock);
+  if (broken)
+    {
+      index_put (index);
+      return NULL;
+    }
+  return index;
+}
+
+/* Releases a reference to INDEX, freeing it once no `struct dir'
+   uses it. */
+static void
+index_put (struct dir_index *index)
+{
+  bool last;
+
+  lock_acquire (&indexes_lock);
+  last = --index->open_cnt == 0;
+  if (last)
+    hash_delete (&indexes, &index->elem);
+  lock_release (&indexes_lock);
+  if (last)
+    index_destroy (index);
+}
+
+/* Frees INDEX and its contents. */
+static void
+index_destroy (struct dir_index *index)
+{
+  hash_destroy (&index->names, name_entry_destroy);
+  while (!list_empty (&index->free_slots))
+    free (list_entry (list_pop_front (&index->free_slots),
+                      struct free_slot, elem));
+  free (index);
+}
+
+/* Returns the entry named NAME in INDEX, or a null pointer. */
+static struct name_entry *
+index_find (const struct dir_index *index, const char *name)
+{
+  struct name_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find ((struct hash *) &index->names, &key.elem);
+  return e != NULL ? hash_entry (e, struct name_entry, elem) : NULL;
+}
+
+/* Adds directory entry E, at offset OFS, to INDEX.
+   Returns false if memory runs out. */
+static bool
+index_add (struct dir_index *index, const struct dir_entry *e, off_t ofs)
+{
+  struct name_entry *n = malloc (sizeof *n);
+  if (n == NULL)
+    return false;
+  strlcpy (n->name, e->name, sizeof n->name);
+  n->inode_sector = e->inode_sector;
+  n->ofs = ofs;
+  hash_insert (&index->names, &n->elem);
+  return true;
+}
+
+/* Records the entry at OFS in INDEX as unused.
+   Returns false if memory runs out. */
+static bool
+index_free_slot (struct dir_index *index, off_t ofs)
+{
+  struct free_slot *slot = malloc (sizeof *slot);
+  if (slot == NULL)
+    return false;
+  slot->ofs = ofs;
+  list_push_back (&index->free_slots, &slot->elem);
+  return true;
+}
+
+/* Frees the name_entry containing E. */
+static void
+name_entry_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct name_entry, elem));
+}
+
+/* Hash and comparison functions for `indexes'. */
+static unsigned
+index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct dir_index, elem)->sector);
+}
+
+static bool
+index_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct dir_index, elem)->sector
+          < hash_entry (b, struct dir_index, elem)->sector);
+}
+
+/* Hash and comparison functions for a dir_index's `names'. */
+static unsigned
+name_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct name_entry, elem)->name);
+}
+
+static bool
+name_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct name_entry, elem)->name,
+                 hash_entry (b, struct name_entry, elem)->name) < 0;
+}
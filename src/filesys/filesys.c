@@ -2,15 +2,19 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static struct dir *resolve (const char *path, char name[NAME_MAX + 1]);
+static void discard_inode (block_sector_t);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +25,9 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dir_init ();
   free_map_init ();
 
   if (format) 
@@ -36,9 +42,12 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
+   NAME is a path, relative to the current directory unless it
+   begins with `/'.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
@@ -46,19 +55,51 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success = false;
+
+  dir = resolve (name, base);
+  if (dir != NULL && free_map_allocate (1, &inode_sector))
+    {
+      if (!inode_create (inode_sector, initial_size, false))
+        free_map_release (inode_sector, 1);
+      else if (!(success = dir_add (dir, base, inode_sector)))
+        discard_inode (inode_sector);
+    }
+  dir_close (dir);
+
+  return success;
+}
+
+/* Creates a directory named NAME, a path like filesys_create()'s.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success = false;
+
+  dir = resolve (name, base);
+  if (dir != NULL && free_map_allocate (1, &inode_sector))
+    {
+      if (!dir_create (inode_sector,
+                       inode_get_inumber (dir_get_inode (dir)), 0))
+        free_map_release (inode_sector, 1);
+      else if (!(success = dir_add (dir, base, inode_sector)))
+        discard_inode (inode_sector);
+    }
   dir_close (dir);
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file with the given NAME, a path like
+   filesys_create()'s, which may also name a directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,38 +107,146 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir;
   struct inode *inode = NULL;
-  ASSERT (dir != NULL);
 
+  dir = resolve (name, base);
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, base, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file named NAME, a path like filesys_create()'s.
+   A directory can be deleted only if it is empty.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  dir = resolve (name, base);
+  success = dir != NULL && dir_remove (dir, base);
   dir_close (dir); 
 
   return success;
 }
+
+/* Makes the directory named NAME, a path like
+   filesys_create()'s, the current thread's current directory.
+   Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char base[NAME_MAX + 1];
+  struct dir *dir, *cwd = NULL;
+  struct inode *inode = NULL;
+
+  dir = resolve (name, base);
+  if (dir != NULL && dir_lookup (dir, base, &inode))
+    {
+      if (inode_is_dir (inode))
+        cwd = dir_open (inode);
+      else
+        inode_close (inode);
+    }
+  dir_close (dir);
+
+  if (cwd == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = cwd;
+  return true;
+}
+
+/* Opens the directory that holds the last component of PATH and
+   stores that component into NAME.  A relative PATH starts from
+   the current thread's current directory, or from the root
+   directory if it has none.  If PATH names the root directory,
+   NAME is ".".  Returns a null pointer if PATH is empty, if a
+   component is longer than NAME_MAX, or if a directory along the
+   way does not exist.  Each directory along the way is locked
+   only while it is searched, so paths resolve concurrently. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct thread *t = thread_current ();
+  struct dir *dir;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' || t->cwd == NULL ? dir_open_root () : dir_reopen (t->cwd);
+
+  while (dir != NULL)
+    {
+      struct inode *inode;
+      size_t len;
+
+      while (*path == '/')
+        path++;
+      len = strcspn (path, "/");
+      if (len > NAME_MAX)
+        break;
+      if (len == 0)
+        strlcpy (name, ".", NAME_MAX + 1);
+      else
+        {
+          memcpy (name, path, len);
+          name[len] = '\0';
+        }
+      path += len;
+      while (*path == '/')
+        path++;
+      if (*path == '\0')
+        return dir;
+
+      /* Not the last component, so it must be a directory. */
+      if (!dir_lookup (dir, name, &inode))
+        break;
+      if (!inode_is_dir (inode))
+        {
+          inode_close (inode);
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+    }
+  dir_close (dir);
+  return NULL;
+}
 
+/* Frees the inode just created in SECTOR, along with its data,
+   when it could not be added to a directory.  Removing it the
+   way dir_remove() does lets inode_close() free every sector it
+   was given. */
+static void
+discard_inode (block_sector_t sector)
+{
+  struct inode *inode = inode_open (sector);
+
+  if (inode != NULL)
+    {
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else
+    free_map_release (sector, 1);
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
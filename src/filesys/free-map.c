@@ -1,52 +1,130 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <limits.h>
+#include <round.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Guards everything here. */
+
+/* A maximal run of free sectors.
+
+   The free extents index the bitmap, so that allocating does not
+   have to scan it.  Each extent is in an AVL tree ordered by
+   length and then by start, so a best fit or the longest extent
+   is found, and an extent added or removed, in O(log n) time.
+   Each extent is also hashed by its first sector and by the
+   sector just past its end, so that a released run merges with
+   its free neighbours at once.  The bitmap stays the authority,
+   and is what goes to disk. */
+struct extent
+  {
+    block_sector_t start;               /* First free sector. */
+    size_t length;                      /* Number of free sectors. */
+    struct extent *left, *right;        /* Children in size_tree. */
+    int height;                         /* Height of subtree in size_tree. */
+    struct hash_elem start_elem;        /* Element in extents_by_start. */
+    struct hash_elem end_elem;          /* Element in extents_by_end. */
+  };
+
+static struct extent *size_tree;        /* Root of the tree by size. */
+static struct hash extents_by_start;
+static struct hash extents_by_end;
+
+static void index_build (void);
+static void index_clear (void);
+static bool take_run (struct extent *, size_t cnt, block_sector_t *sectorp);
+static bool write_range (block_sector_t start, size_t cnt);
+static void extent_insert (block_sector_t start, size_t length);
+static void extent_remove (struct extent *);
+static void extent_link (struct extent *);
+static struct extent *best_fit (size_t cnt);
+static struct extent *largest (void);
+static struct extent *tree_insert (struct extent *root, struct extent *);
+static struct extent *tree_delete (struct extent *root, struct extent *);
+static struct extent *extent_at (struct hash *, block_sector_t);
+static unsigned start_hash (const struct hash_elem *, void *);
+static bool start_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static unsigned end_hash (const struct hash_elem *, void *);
+static bool end_less (const struct hash_elem *, const struct hash_elem *,
+                      void *);
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+
+  size_tree = NULL;
+  if (!hash_init (&extents_by_start, start_hash, start_less, NULL)
+      || !hash_init (&extents_by_end, end_hash, end_less, NULL))
+    PANIC ("free extent index creation failed");
+  index_build ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The shortest free run that fits is
+   used, which leaves long runs for files to grow into.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available or if the free_map file could not be
+   written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = take_run (best_fit (cnt), cnt, sectorp);
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Allocates one sector and stores it into *SECTORP, preferring
+   HINT, so that a file growing a sector at a time stays
+   sequential on disk.  If HINT is not the start of a free run,
+   or is 0 for no preference, the sector comes from the start of
+   the longest free run, where the file has the most room to
+   continue.
+   Returns true if successful, false if the disk is full or if
+   the free_map file could not be written. */
+bool
+free_map_allocate_near (block_sector_t hint, block_sector_t *sectorp)
+{
+  struct extent *e;
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  e = extent_at (&extents_by_start, hint);
+  success = take_run (e != NULL ? e : largest (), 1, sectorp);
+  lock_release (&free_map_lock);
+  return success;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
+  cache_invalidate (sector, cnt);
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_range (sector, cnt);
+  extent_insert (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,6 +136,8 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  index_clear ();
+  index_build ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -73,7 +153,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -83,3 +163,354 @@ free_map_create (void)
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Adds an extent for every run of free sectors in the bitmap. */
+static void
+index_build (void)
+{
+  size_t start = 0, end;
+
+  while ((start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR)
+    {
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (free_map);
+      extent_insert (start, end - start);
+      start = end;
+    }
+}
+
+/* Discards every extent. */
+static void
+index_clear (void)
+{
+  while (size_tree != NULL)
+    {
+      struct extent *e = size_tree;
+      extent_remove (e);
+      free (e);
+    }
+}
+
+/* Allocates the first CNT sectors of extent E, which must be at
+   least that long, stores the first into *SECTORP, and records
+   them in the free map file.  Returns false if E is null or the
+   free map file could not be written. */
+static bool
+take_run (struct extent *e, size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t start;
+
+  if (e == NULL)
+    return false;
+  ASSERT (e->length >= cnt);
+
+  start = e->start;
+  bitmap_set_multiple (free_map, start, cnt, true);
+  if (free_map_file != NULL && !write_range (start, cnt))
+    {
+      bitmap_set_multiple (free_map, start, cnt, false);
+      return false;
+    }
+
+  extent_remove (e);
+  if (e->length > cnt)
+    {
+      e->start += cnt;
+      e->length -= cnt;
+      extent_link (e);
+    }
+  else
+    free (e);
+  *sectorp = start;
+  return true;
+}
+
+/* Writes the sectors of the free map file that hold the bits for
+   the CNT sectors starting at START, instead of the whole file.
+   Returns true if successful, false otherwise. */
+static bool
+write_range (block_sector_t start, size_t cnt)
+{
+  const size_t bits_per_sector = BLOCK_SECTOR_SIZE * CHAR_BIT;
+  size_t first = ROUND_DOWN (start, bits_per_sector);
+  size_t end = ROUND_UP (start + cnt, bits_per_sector);
+
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  return bitmap_write_range (free_map, free_map_file, first, end - first);
+}
+
+/* Adds the LENGTH free sectors starting at START to the index,
+   merged with the free runs just before and after them.  If
+   memory runs out the sectors are left out of the index: they
+   stay free in the bitmap and are indexed again at the next
+   boot. */
+static void
+extent_insert (block_sector_t start, size_t length)
+{
+  struct extent *before = extent_at (&extents_by_end, start);
+  struct extent *after = extent_at (&extents_by_start, start + length);
+  struct extent *e = NULL;
+
+  if (before != NULL)
+    {
+      extent_remove (before);
+      start = before->start;
+      length += before->length;
+      e = before;
+    }
+  if (after != NULL)
+    {
+      extent_remove (after);
+      length += after->length;
+      if (before != NULL)
+        free (after);
+      else
+        e = after;
+    }
+  if (e == NULL)
+    {
+      e = malloc (sizeof *e);
+      if (e == NULL)
+        return;
+    }
+  e->start = start;
+  e->length = length;
+  extent_link (e);
+}
+
+/* Removes E from the index, without freeing it. */
+static void
+extent_remove (struct extent *e)
+{
+  size_tree = tree_delete (size_tree, e);
+  hash_delete (&extents_by_start, &e->start_elem);
+  hash_delete (&extents_by_end, &e->end_elem);
+}
+
+/* Adds E to the index according to its start and length. */
+static void
+extent_link (struct extent *e)
+{
+  ASSERT (e->length > 0);
+  e->left = e->right = NULL;
+  e->height = 1;
+  size_tree = tree_insert (size_tree, e);
+  hash_insert (&extents_by_start, &e->start_elem);
+  hash_insert (&extents_by_end, &e->end_elem);
+}
+
+/* Returns the shortest extent at least CNT sectors long, or a
+   null pointer if there is none. */
+static struct extent *
+best_fit (size_t cnt)
+{
+  struct extent *e, *fit = NULL;
+
+  if (cnt == 0)
+    return NULL;
+  for (e = size_tree; e != NULL; )
+    if (e->length >= cnt)
+      {
+        fit = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return fit;
+}
+
+/* Returns the longest extent, or a null pointer if no sector is
+   free. */
+static struct extent *
+largest (void)
+{
+  struct extent *e = size_tree;
+
+  if (e != NULL)
+    while (e->right != NULL)
+      e = e->right;
+  return e;
+}
+
+/* Returns true if extent A comes before B in size_tree. */
+static bool
+size_less (const struct extent *a, const struct extent *b)
+{
+  return (a->length < b->length
+          || (a->length == b->length && a->start < b->start));
+}
+
+/* Returns the height of the subtree rooted at E. */
+static int
+tree_height (const struct extent *e)
+{
+  return e != NULL ? e->height : 0;
+}
+
+/* Recomputes E's height from its children's. */
+static void
+tree_update (struct extent *e)
+{
+  int l = tree_height (e->left), r = tree_height (e->right);
+  e->height = (l > r ? l : r) + 1;
+}
+
+/* Rotates the subtree rooted at E so that its left child becomes
+   its root, and returns the new root. */
+static struct extent *
+rotate_right (struct extent *e)
+{
+  struct extent *l = e->left;
+  e->left = l->right;
+  l->right = e;
+  tree_update (e);
+  tree_update (l);
+  return l;
+}
+
+/* Rotates the subtree rooted at E so that its right child becomes
+   its root, and returns the new root. */
+static struct extent *
+rotate_left (struct extent *e)
+{
+  struct extent *r = e->right;
+  e->right = r->left;
+  r->left = e;
+  tree_update (e);
+  tree_update (r);
+  return r;
+}
+
+/* Restores the AVL balance of the subtree rooted at E, whose
+   children are balanced and differ in height by at most 2, and
+   returns its new root. */
+static struct extent *
+tree_balance (struct extent *e)
+{
+  int diff = tree_height (e->left) - tree_height (e->right);
+
+  if (diff > 1)
+    {
+      if (tree_height (e->left->left) < tree_height (e->left->right))
+        e->left = rotate_left (e->left);
+      return rotate_right (e);
+    }
+  else if (diff < -1)
+    {
+      if (tree_height (e->right->right) < tree_height (e->right->left))
+        e->right = rotate_right (e->right);
+      return rotate_left (e);
+    }
+  tree_update (e);
+  return e;
+}
+
+/* Inserts E into the subtree rooted at ROOT and returns the
+   subtree's new root. */
+static struct extent *
+tree_insert (struct extent *root, struct extent *e)
+{
+  if (root == NULL)
+    return e;
+  if (size_less (e, root))
+    root->left = tree_insert (root->left, e);
+  else
+    root->right = tree_insert (root->right, e);
+  return tree_balance (root);
+}
+
+/* Removes the first extent in the subtree rooted at ROOT, stores
+   it in *FIRST, and returns the subtree's new root. */
+static struct extent *
+tree_delete_first (struct extent *root, struct extent **first)
+{
+  if (root->left == NULL)
+    {
+      *first = root;
+      return root->right;
+    }
+  root->left = tree_delete_first (root->left, first);
+  return tree_balance (root);
+}
+
+/* Removes E, which must be present, from the subtree rooted at
+   ROOT and returns the subtree's new root. */
+static struct extent *
+tree_delete (struct extent *root, struct extent *e)
+{
+  ASSERT (root != NULL);
+  if (root == e)
+    {
+      struct extent *next;
+
+      if (e->right == NULL)
+        return e->left;
+      e->right = tree_delete_first (e->right, &next);
+      next->left = e->left;
+      next->right = e->right;
+      return tree_balance (next);
+    }
+  if (size_less (e, root))
+    root->left = tree_delete (root->left, e);
+  else
+    root->right = tree_delete (root->right, e);
+  return tree_balance (root);
+}
+
+/* Returns the extent in HASH, which is extents_by_start or
+   extents_by_end, whose key is SECTOR, or a null pointer. */
+static struct extent *
+extent_at (struct hash *hash, block_sector_t sector)
+{
+  struct extent key;
+  struct hash_elem *e;
+
+  if (hash == &extents_by_start)
+    {
+      key.start = sector;
+      e = hash_find (hash, &key.start_elem);
+      return e != NULL ? hash_entry (e, struct extent, start_elem) : NULL;
+    }
+  else
+    {
+      key.start = sector;
+      key.length = 0;
+      e = hash_find (hash, &key.end_elem);
+      return e != NULL ? hash_entry (e, struct extent, end_elem) : NULL;
+    }
+}
+
+/* Hash and comparison functions for extents_by_start. */
+static unsigned
+start_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct extent, start_elem)->start);
+}
+
+static bool
+start_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct extent, start_elem)->start
+          < hash_entry (b, struct extent, start_elem)->start);
+}
+
+/* Hash and comparison functions for extents_by_end, keyed by the
+   sector just past each extent. */
+static unsigned
+end_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct extent *e = hash_entry (e_, struct extent, end_elem);
+  return hash_int (e->start + e->length);
+}
+
+static bool
+end_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct extent *a = hash_entry (a_, struct extent, end_elem);
+  const struct extent *b = hash_entry (b_, struct extent, end_elem);
+  return a->start + a->length < b->start + b->length;
+}
@@ -1,23 +1,44 @@
 #include "filesys/inode.h"
-#include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Most full sectors moved between disk and a caller's buffer
+   with one block request. */
+#define RUN_MAX_SECTORS 64
+
+/* Sector pointers held directly in the on-disk inode, and in
+   each indirect sector. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Most data sectors a file can have: the direct ones, those
+   reached through the indirect sector, and those reached through
+   the doubly indirect sector. */
+#define MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   A sector pointer of 0 marks a hole, which reads as zeros: the
+   free map's own inode lives in sector 0, so no data can. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Data sectors. */
+    block_sector_t indirect;            /* Sector of data sector pointers. */
+    block_sector_t doubly_indirect;     /* Sector of indirect sector pointers. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* Nonzero for a directory. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +49,105 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+static block_sector_t index_lookup (const struct inode_disk *, size_t idx);
+static block_sector_t index_allocate (struct inode_disk *, size_t idx);
+static void index_free (const struct inode_disk *);
+
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool loaded;                        /* True once `data' is read in. */
     struct inode_disk data;             /* Inode content. */
+
+    /* Reader/writer lock on the inode's data, so that reads of
+       the same file proceed together.  open_cnt, removed and
+       loaded are guarded by open_inodes_lock instead. */
+    struct lock rw_lock;                /* Guards the members below. */
+    struct condition rw_cond;           /* Signaled when the data is released. */
+    int readers;                        /* Threads reading the data. */
+    int writers_waiting;                /* Threads waiting to write it. */
+    bool writing;                       /* True while a thread writes it. */
   };
 
+static void read_lock (struct inode *);
+static void read_unlock (struct inode *);
+static void write_lock (struct inode *);
+static void write_unlock (struct inode *);
+static unsigned inode_hash (const struct hash_elem *, void *);
+static bool inode_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, because POS is past the end of the file or in a hole. */
 block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+  sector = index_lookup (&inode->data, pos / BLOCK_SECTOR_SIZE);
+  return sector != 0 ? sector : (block_sector_t) -1;
+}
+
+/* Returns the number of whole sectors, at most RUN_MAX_SECTORS,
+   that can be read directly into the caller's buffer from
+   INODE starting at sector-aligned OFFSET with SIZE bytes
+   left to go: sectors wholly inside both the file and the
+   request, lying consecutively on disk. */
+static int
+full_sector_run (const struct inode *inode, off_t offset, off_t size)
+{
+  block_sector_t first = byte_to_sector (inode, offset);
+  int cnt = 0;
+
+  while (cnt < RUN_MAX_SECTORS
+         && size - cnt * BLOCK_SECTOR_SIZE >= BLOCK_SECTOR_SIZE
+         && inode->data.length - offset - cnt * BLOCK_SECTOR_SIZE >= BLOCK_SECTOR_SIZE
+         && byte_to_sector (inode, offset + cnt * BLOCK_SECTOR_SIZE) == first + cnt)
+    cnt++;
+  return cnt;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Guards open_inodes and each open inode's open_cnt, removed
+   and loaded. */
+static struct lock open_inodes_lock;
+
+/* Signaled when an open inode has been loaded from disk.  An
+   inode is entered in open_inodes before it is read in, so that
+   the read happens without open_inodes_lock, and other openers
+   of it wait here. */
+static struct condition inode_loaded;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("open inode table creation failed");
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_loaded);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Initializes an inode with LENGTH bytes of data, as a
+   directory if IS_DIR is true, and writes the new inode to
+   sector SECTOR on the file system device.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -85,21 +162,22 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->is_dir = is_dir;
+
+      /* Allocate the initial data up front, so that running out
+         of space is reported here.  Only writes past the end of
+         file leave holes. */
+      success = sectors <= MAX_SECTORS;
+      for (i = 0; success && i < sectors; i++)
+        success = index_allocate (disk_inode, i) != 0;
+      if (success)
+        cache_write (sector, disk_inode);
+      else
+        index_free (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +189,51 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  key.sector = sector;
+  lock_acquire (&open_inodes_lock);
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL) 
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      while (!inode->loaded)
+        cond_wait (&inode_loaded, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+      return inode; 
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->loaded = false;
+  lock_init (&inode->rw_lock);
+  cond_init (&inode->rw_cond);
+  inode->readers = inode->writers_waiting = 0;
+  inode->writing = false;
+  lock_release (&open_inodes_lock);
+
+  /* Read it in without holding up other opens and closes. */
+  cache_read (inode->sector, &inode->data);
+  lock_acquire (&open_inodes_lock);
+  inode->loaded = true;
+  cond_broadcast (&inode_loaded, &open_inodes_lock);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -146,7 +242,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -168,21 +268,24 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Remove from open inode table and release lock. */
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          index_free (&inode->data);
         }
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +294,23 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Returns true if INODE has been marked to be deleted. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,12 +321,21 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool through_cache;
 
+  /* A sequential reader's next read is likely the same size as
+     this one.  If it will start on a sector boundary and cover a
+     whole sector, it will bypass the cache, so reading ahead for
+     it would only cost an extra disk read. */
+  through_cache = size < BLOCK_SECTOR_SIZE
+                  || (offset + size) % BLOCK_SECTOR_SIZE != 0;
+
+  read_lock (inode);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = index_lookup (&inode->data,
+                                                offset / BLOCK_SECTOR_SIZE);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,99 +348,103 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx == 0)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
+          /* Holes read as zeros. */
+          memset (buffer + bytes_read, 0, chunk_size);
         }
-      else 
+      else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Read a run of full sectors directly into caller's
+             buffer, once any newer cached copies are on disk. */
+          void *sectors[RUN_MAX_SECTORS];
+          int i, cnt = full_sector_run (inode, offset, size);
+          for (i = 0; i < cnt; i++)
+            sectors[i] = buffer + bytes_read + i * BLOCK_SECTOR_SIZE;
+          cache_sync (sector_idx, cnt);
+          block_read_multiple (fs_device, sector_idx, cnt, sectors);
+          chunk_size = cnt * BLOCK_SECTOR_SIZE;
         }
+      else 
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Start fetching the sector a sequential reader will want
+     next, if it will read it through the cache. */
+  if (bytes_read > 0 && through_cache
+      && byte_to_sector (inode, offset) != (block_sector_t) -1)
+    cache_readahead (byte_to_sector (inode, offset));
+  read_unlock (inode);
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the file reaches its
+   maximum size.  Writing past end of file extends the file; any
+   gap between the old end of file and OFFSET is left as a hole
+   that reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
 
+  write_lock (inode);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      write_unlock (inode);
+      return 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx = index_lookup (&inode->data, idx);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
-
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Fill in a hole, or grow the file by a sector. */
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          changed = true;
+          sector_idx = index_allocate (&inode->data, idx);
+          if (sector_idx == 0)
+            break;
         }
 
+      /* Write into the cached sector.  The cache reads the
+         sector in first only if the chunk does not cover it. */
+      cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+                      chunk_size);
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    cache_write (inode->sector, &inode->data);
+  write_unlock (inode);
 
   return bytes_written;
 }
@@ -322,8 +454,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  write_lock (inode);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  write_unlock (inode);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +466,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  write_lock (inode);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  write_unlock (inode);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +479,215 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Allocates a sector, zeroes it, and stores it in *SECTORP.
+   Indirect sectors, with DATA false, fill the smallest free gap.
+   Data sectors go just after PREV, the file's previous data
+   sector or 0 if there is none, when that is free, to keep the
+   file sequential on disk.
+   Returns false if the disk is full. */
+static bool
+allocate_zeroed (block_sector_t *sectorp, bool data, block_sector_t prev)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!(data
+        ? free_map_allocate_near (prev != 0 ? prev + 1 : 0, sectorp)
+        : free_map_allocate (1, sectorp)))
+    return false;
+  cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* Returns pointer SLOT of indirect sector TABLE, or 0 if the
+   slot is empty. */
+static block_sector_t
+table_get (block_sector_t table, size_t slot)
+{
+  block_sector_t sector;
+
+  cache_read_at (table, &sector, slot * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns pointer SLOT of indirect sector TABLE, first filling
+   the slot with a newly allocated, zeroed sector if it is empty,
+   as allocate_zeroed() does with DATA and PREV.  Returns 0 if
+   the disk is full. */
+static block_sector_t
+table_allocate (block_sector_t table, size_t slot, bool data,
+                block_sector_t prev)
+{
+  block_sector_t sector = table_get (table, slot);
+
+  if (sector == 0 && allocate_zeroed (&sector, data, prev))
+    cache_write_at (table, &sector, slot * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the sector holding data sector IDX of the file whose
+   inode is DISK, or 0 if that sector is a hole. */
+static block_sector_t
+index_lookup (const struct inode_disk *disk, size_t idx)
+{
+  if (idx < DIRECT_CNT)
+    return disk->direct[idx];
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return disk->indirect != 0 ? table_get (disk->indirect, idx) : 0;
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR && disk->doubly_indirect != 0)
+    {
+      block_sector_t table = table_get (disk->doubly_indirect,
+                                        idx / PTRS_PER_SECTOR);
+      if (table != 0)
+        return table_get (table, idx % PTRS_PER_SECTOR);
+    }
+  return 0;
+}
+
+/* Returns the sector holding data sector IDX of the file whose
+   inode is DISK, allocating a zeroed one, and any indirect
+   sectors needed to reach it, if it is a hole.  Updates DISK in
+   memory only; the caller must write it out.  Returns 0 if the
+   disk is full or IDX is beyond the largest possible file. */
+static block_sector_t
+index_allocate (struct inode_disk *disk, size_t idx)
+{
+  block_sector_t prev = idx > 0 ? index_lookup (disk, idx - 1) : 0;
+
+  if (idx < DIRECT_CNT)
+    {
+      if (disk->direct[idx] == 0)
+        allocate_zeroed (&disk->direct[idx], true, prev);
+      return disk->direct[idx];
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      if (disk->indirect == 0
+          && !allocate_zeroed (&disk->indirect, false, 0))
+        return 0;
+      return table_allocate (disk->indirect, idx, true, prev);
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      block_sector_t table;
+
+      if (disk->doubly_indirect == 0
+          && !allocate_zeroed (&disk->doubly_indirect, false, 0))
+        return 0;
+      table = table_allocate (disk->doubly_indirect, idx / PTRS_PER_SECTOR,
+                              false, 0);
+      if (table != 0)
+        return table_allocate (table, idx % PTRS_PER_SECTOR, true, prev);
+    }
+  return 0;
+}
+
+/* Releases indirect sector TABLE and the sectors it points to.
+   If DEPTH is greater than 1, the sectors it points to are
+   themselves indirect sectors, DEPTH - 1 levels above the
+   data. */
+static void
+table_free (block_sector_t table, int depth)
+{
+  size_t slot;
+
+  for (slot = 0; slot < PTRS_PER_SECTOR; slot++)
+    {
+      block_sector_t sector = table_get (table, slot);
+      if (sector == 0)
+        continue;
+      if (depth > 1)
+        table_free (sector, depth - 1);
+      else
+        free_map_release (sector, 1);
+    }
+  free_map_release (table, 1);
+}
+
+/* Releases every data and indirect sector of the file whose
+   inode is DISK. */
+static void
+index_free (const struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  if (disk->indirect != 0)
+    table_free (disk->indirect, 1);
+  if (disk->doubly_indirect != 0)
+    table_free (disk->doubly_indirect, 2);
+}
+
+/* Acquires INODE's data for reading, alongside any other
+   readers.  Waits while a writer holds the data or is waiting
+   for it, so that a stream of readers cannot starve writers. */
+static void
+read_lock (struct inode *inode)
+{
+  lock_acquire (&inode->rw_lock);
+  while (inode->writing || inode->writers_waiting > 0)
+    cond_wait (&inode->rw_cond, &inode->rw_lock);
+  inode->readers++;
+  lock_release (&inode->rw_lock);
+}
+
+/* Releases INODE's data acquired with read_lock(). */
+static void
+read_unlock (struct inode *inode)
+{
+  lock_acquire (&inode->rw_lock);
+  ASSERT (inode->readers > 0);
+  if (--inode->readers == 0)
+    cond_broadcast (&inode->rw_cond, &inode->rw_lock);
+  lock_release (&inode->rw_lock);
+}
+
+/* Acquires INODE's data for writing, excluding all other
+   readers and writers. */
+static void
+write_lock (struct inode *inode)
+{
+  lock_acquire (&inode->rw_lock);
+  inode->writers_waiting++;
+  while (inode->writing || inode->readers > 0)
+    cond_wait (&inode->rw_cond, &inode->rw_lock);
+  inode->writers_waiting--;
+  inode->writing = true;
+  lock_release (&inode->rw_lock);
+}
+
+/* Releases INODE's data acquired with write_lock(). */
+static void
+write_unlock (struct inode *inode)
+{
+  lock_acquire (&inode->rw_lock);
+  ASSERT (inode->writing);
+  inode->writing = false;
+  cond_broadcast (&inode->rw_cond, &inode->rw_lock);
+  lock_release (&inode->rw_lock);
+}
+
+/* Hash and comparison functions for open_inodes. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
@@ -0,0 +1,61 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point real numbers, for the load average
+   and recent_cpu values of the multi-level feedback queue
+   scheduler.  The kernel does not use floating point.
+
+   Functions named with `_int' take an integer as their second
+   operand. */
+
+typedef int32_t fixed_t;
+
+#define FIX_SHIFT 14                      /* Number of fraction bits. */
+#define FIX_ONE (1 << FIX_SHIFT)          /* 1.0. */
+
+/* Converts integer N to fixed point. */
+static inline fixed_t fix_int (int n) {
+  return n * FIX_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int fix_trunc (fixed_t x) {
+  return x / FIX_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int fix_round (fixed_t x) {
+  return x >= 0 ? (x + FIX_ONE / 2) / FIX_ONE : (x - FIX_ONE / 2) / FIX_ONE;
+}
+
+static inline fixed_t fix_add (fixed_t x, fixed_t y) {
+  return x + y;
+}
+
+static inline fixed_t fix_add_int (fixed_t x, int n) {
+  return x + n * FIX_ONE;
+}
+
+static inline fixed_t fix_sub (fixed_t x, fixed_t y) {
+  return x - y;
+}
+
+static inline fixed_t fix_mul (fixed_t x, fixed_t y) {
+  return (int64_t) x * y / FIX_ONE;
+}
+
+static inline fixed_t fix_mul_int (fixed_t x, int n) {
+  return x * n;
+}
+
+static inline fixed_t fix_div (fixed_t x, fixed_t y) {
+  return (int64_t) x * FIX_ONE / y;
+}
+
+static inline fixed_t fix_div_int (fixed_t x, int n) {
+  return x / n;
+}
+
+#endif /* threads/fixed-point.h */
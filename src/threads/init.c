@@ -23,6 +23,7 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #include "vm/frame.h"
+#include "vm/page.h"
 #include "vm/swap.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -66,6 +67,10 @@ static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+#ifdef VM
+static size_t parse_page_count (const char *name, const char *value,
+                                size_t max);
+#endif
 
 #ifdef FILESYS
 static void locate_block_devices (void);
@@ -140,10 +145,6 @@ main (void)
   run_actions (argv);
 
   /* Finish up. */
-#ifdef USERPROG
-  frame_table_destroy ();
-  swap_destroy ();
-#endif
   shutdown ();
   thread_exit ();
 }
@@ -261,6 +262,10 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-swap-ra"))
+        swap_readahead_pages = parse_page_count (name, value, SWAP_BATCH_MAX);
+      else if (!strcmp (name, "-fault-around"))
+        fault_around_pages = parse_page_count (name, value, FAULT_AROUND_MAX);
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
@@ -288,6 +293,24 @@ parse_options (char **argv)
   return argv;
 }
 
+#ifdef VM
+/* Returns VALUE, the value given for option NAME, as a number of
+   pages, limited to MAX.  Panics if VALUE is missing or
+   negative. */
+static size_t
+parse_page_count (const char *name, const char *value, size_t max)
+{
+  int cnt;
+
+  if (value == NULL)
+    PANIC ("option `%s' requires a value", name);
+  cnt = atoi (value);
+  if (cnt < 0)
+    PANIC ("option `%s' must not be negative", name);
+  return (size_t) cnt < max ? (size_t) cnt : max;
+}
+#endif
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -386,6 +409,8 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap-ra=COUNT     Read ahead up to COUNT pages on swap-in.\n"
+          "  -fault-around=N    Map file pages N at a time on faults.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
@@ -148,6 +148,32 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the index of PAGE within the user pool, that is,
+   (PAGE - base of user pool) / PGSIZE.  PAGE must have been
+   obtained with PAL_USER. */
+size_t
+palloc_user_page_idx (const void *page)
+{
+  ASSERT (page_from_pool (&user_pool, (void *) page));
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Returns the page at index IDX within the user pool, the
+   inverse of palloc_user_page_idx. */
+void *
+palloc_user_page_addr (size_t idx)
+{
+  ASSERT (idx < bitmap_size (user_pool.used_map));
+  return user_pool.base + idx * PGSIZE;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -32,6 +32,14 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Most locks deep that a priority donation propagates through a
+   chain of holders each waiting for the next lock. */
+#define DONATE_DEPTH 8
+
+static void waiter_insert (struct semaphore *, struct thread *);
+static void lock_take (struct lock *);
+static void donate (struct lock *, int priority);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -68,7 +76,9 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+      waiter_insert (sema, cur);
+      cur->waiting_sema = sema;
       thread_block ();
     }
   sema->value--;
@@ -102,7 +112,9 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the current
+   thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +126,43 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct thread *t = list_entry (list_pop_front (&sema->waiters),
+                                     struct thread, elem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Moves T, which is waiting for SEMA, to its place in SEMA's
+   waiters after a change in its priority.  Interrupts must be
+   off. */
+void
+sema_requeue (struct semaphore *sema, struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->waiting_sema == sema);
+
+  list_remove (&t->elem);
+  waiter_insert (sema, t);
+}
+
+/* Inserts T into SEMA's waiters, which are kept in order of
+   decreasing priority, behind the waiters of equal priority.
+   The search starts from the back, so that it ends at once when
+   all the waiters have the same priority. */
+static void
+waiter_insert (struct semaphore *sema, struct thread *t) 
+{
+  struct list_elem *e = list_rbegin (&sema->waiters);
+
+  while (e != list_rend (&sema->waiters)
+         && list_entry (e, struct thread, elem)->priority < t->priority)
+    e = list_prev (e);
+  list_insert (list_next (e), &t->elem);
 }
 
 static void sema_test_helper (void *sema_);
@@ -178,6 +223,7 @@ lock_init (struct lock *lock)
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
+  lock->max_priority = PRI_MIN;
   sema_init (&lock->semaphore, 1);
 }
 
@@ -185,6 +231,10 @@ lock_init (struct lock *lock)
    necessary.  The lock must not already be held by the current
    thread.
 
+   While waiting, the current thread donates its priority to
+   the holder, and on through the locks the holder is itself
+   waiting for, up to DONATE_DEPTH locks deep.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +242,23 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->waiting_lock = lock;
+      donate (lock, cur->priority);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +270,23 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   The current thread gives up the priority donated through LOCK,
+   and yields if a waiter it wakes now has a higher priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +294,59 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  thread_refresh_priority (thread_current ());
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Makes the current thread the holder of LOCK, which it has
+   just downed, and takes on the priorities of the threads still
+   waiting for it.  Interrupts must be off. */
+static void
+lock_take (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock->holder = cur;
+  lock->max_priority = PRI_MIN;
+  if (!thread_mlfqs && !list_empty (&lock->semaphore.waiters))
+    lock->max_priority = list_entry (list_front (&lock->semaphore.waiters),
+                                     struct thread, elem)->priority;
+  list_push_back (&cur->locks, &lock->elem);
+  thread_refresh_priority (cur);
+}
+
+/* Donates PRIORITY to the holder of LOCK and, if the holder is
+   itself waiting for a lock, on down the chain of holders, up to
+   DONATE_DEPTH locks deep.  Stops early at a lock that already
+   carries that much priority, since the rest of the chain has it
+   too.  Interrupts must be off. */
+static void
+donate (struct lock *lock, int priority) 
+{
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATE_DEPTH && lock != NULL; depth++)
+    {
+      if (lock->holder == NULL || lock->max_priority >= priority)
+        break;
+      lock->max_priority = priority;
+      thread_refresh_priority (lock->holder);
+      lock = lock->holder->waiting_lock;
+    }
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,6 +365,7 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -295,6 +410,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +418,10 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the one with the highest priority to
+   wake up from its wait, or the longest waiting among those of
+   equal priority.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +435,21 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct semaphore_elem *best = NULL;
+      struct list_elem *e;
+
+      for (e = list_begin (&cond->waiters); e != list_end (&cond->waiters);
+           e = list_next (e))
+        {
+          struct semaphore_elem *w = list_entry (e, struct semaphore_elem,
+                                                 elem);
+          if (best == NULL || w->thread->priority > best->thread->priority)
+            best = w;
+        }
+      list_remove (&best->elem);
+      sema_up (&best->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
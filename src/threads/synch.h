@@ -4,24 +4,29 @@
 #include <list.h>
 #include <stdbool.h>
 
+struct thread;
+
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct list waiters;        /* Waiting threads, highest priority first. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_requeue (struct semaphore *, struct thread *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    int max_priority;           /* Highest priority donated by waiters. */
+    struct list_elem elem;      /* Element in the holder's `locks'. */
   };
 
 void lock_init (struct lock *);
@@ -33,7 +38,7 @@ bool lock_held_by_current_thread (const struct lock *);
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct list waiters;        /* Waiting threads, in order of arrival. */
   };
 
 void cond_init (struct condition *);
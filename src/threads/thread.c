@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -22,9 +23,15 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one FIFO queue per
+   priority.  Bit P of ready_bits is set when ready_queues[P] is
+   not empty, so that the highest priority with a ready thread is
+   found with a single bit scan per word. */
+#define READY_WORDS ((PRI_MAX + 32) / 32)
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_bits[READY_WORDS];
+static int ready_cnt;                   /* Threads in the run queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -56,11 +63,18 @@ static long long user_ticks;    /* # of timer ticks in user programs. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
-/* If false (default), use round-robin scheduler.
+/* If false (default), use the priority scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler.  Each second the load
+   average is updated and every thread's recent_cpu decays, and
+   every fourth tick the running thread's priority, the only one
+   whose recent_cpu has grown since, is recomputed. */
+#define MLFQS_PRI_TICKS 4       /* Ticks between priority updates. */
+static fixed_t load_avg;        /* Estimated threads ready over past minute. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -72,13 +86,20 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (void);
 static tid_t allocate_tid (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_decay (struct thread *, void *coef);
+static void mlfqs_update_priority (struct thread *);
+static int mlfqs_priority (const struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -89,10 +110,13 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri]);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -136,8 +160,12 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
+  /* Enforce preemption, both at the end of a time slice and
+     whenever a higher-priority thread has become ready. */
+  if (++thread_ticks >= TIME_SLICE || ready_max_priority () > t->priority)
     intr_yield_on_return ();
 }
 
@@ -161,9 +189,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread's PRIORITY is higher than the running
+   thread's, the new thread preempts it at once. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -242,10 +269,13 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only once that is safe: on
+   return from an interrupt handler, or at once if the caller had
+   interrupts on.  If the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data, so then the caller should call
+   thread_preempt() after turning interrupts back on. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -255,9 +285,31 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
+}
+
+/* Yields the CPU if a thread with a higher priority than the
+   running thread is ready.  In an interrupt handler, the yield
+   happens on return from the interrupt.  Does nothing while
+   interrupts are off, in which case the next timer tick
+   preempts. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_max_priority () > running_thread ()->priority;
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
 }
 
 /* Returns the name of the running thread. */
@@ -326,7 +378,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -349,11 +401,63 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's priority to NEW_PRIORITY, and
+   yields if a ready thread now has a higher priority.  Donations
+   the thread has received still apply on top of it.  Ignored
+   under the MLFQS scheduler, which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Recomputes T's priority as the higher of its base priority
+   and the priorities donated through the locks it holds, moving
+   T to its new place in its run queue or semaphore wait list.
+   Does not preempt.
+   Interrupts must be off. */
+void
+thread_refresh_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&t->locks); e != list_end (&t->locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->max_priority > priority)
+        priority = lock->max_priority;
+    }
+
+  if (priority == t->priority)
+    return;
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    {
+      t->priority = priority;
+      if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL)
+        sema_requeue (t->waiting_sema, t);
+    }
 }
 
 /* Returns the current thread's priority. */
@@ -365,44 +469,58 @@ thread_get_priority (void)
 
 /* Sets the current thread's nice value to NICE. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fix_round (fix_mul_int (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fix_round (fix_mul_int (thread_current ()->recent_cpu,
+                                               100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The idle thread is initially put on a ready queue by
    thread_start().  It will be scheduled once initially, at which
    point it initializes idle_thread, "up"s the semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   ready queues.  It is returned by next_thread_to_run() as a
+   special case when the ready queues are empty. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
@@ -465,7 +583,9 @@ is_thread (struct thread *t)
 }
 
 /* Does basic initialization of T as a blocked thread named
-   NAME. */
+   NAME.  Under the MLFQS scheduler, T inherits the running
+   thread's nice and recent_cpu values, and PRIORITY is replaced
+   by the priority they give. */
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
@@ -477,13 +597,24 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  if (thread_mlfqs)
+    {
+      if (t != initial_thread)
+        {
+          t->nice = running_thread ()->nice;
+          t->recent_cpu = running_thread ()->recent_cpu;
+        }
+      priority = mlfqs_priority (t);
+    }
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks);
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
 
   /* Scott is driving. */
   /* Initialize child list and thread semaphores. */
   list_init (&t->children);
+  list_init (&t->mmaps);
   sema_init (&t->child_sema, 0);
   sema_init (&t->load_sema, 0);
   sema_init (&t->child_list_sema, 1);
@@ -505,18 +636,129 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
+/* Chooses and returns the next thread to be scheduled: the
+   thread at the front of the highest-priority nonempty run
+   queue.  (If the running thread can continue running, then it
+   will be in a run queue.)  If the run queues are empty, return
    idle_thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (pri < PRI_MIN)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  queue = &ready_queues[pri];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  ready_cnt--;
+  if (list_empty (queue))
+    ready_bits[pri / 32] &= ~(1u << (pri % 32));
+  return t;
+}
+
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_push (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_cnt++;
+  ready_bits[t->priority / 32] |= 1u << (t->priority % 32);
+}
+
+/* Removes ready thread T from its run queue.  Interrupts must
+   be off. */
+static void
+ready_remove (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  ready_cnt--;
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bits[t->priority / 32] &= ~(1u << (t->priority % 32));
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if no thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void) 
+{
+  int word;
+
+  for (word = READY_WORDS - 1; word >= 0; word--)
+    if (ready_bits[word] != 0)
+      return word * 32 + 31 - __builtin_clz (ready_bits[word]);
+  return PRI_MIN - 1;
+}
+
+/* Updates the MLFQS statistics at a timer tick, during which
+   CUR was running. */
+static void
+mlfqs_tick (struct thread *cur) 
+{
+  int64_t now = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fix_add_int (cur->recent_cpu, 1);
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (cur != idle_thread ? 1 : 0);
+      fixed_t twice_load, coef;
+
+      load_avg = fix_div_int (fix_add_int (fix_mul_int (load_avg, 59),
+                                           ready_threads), 60);
+      twice_load = fix_mul_int (load_avg, 2);
+      coef = fix_div (twice_load, fix_add_int (twice_load, 1));
+      thread_foreach (mlfqs_decay, &coef);
+    }
+  else if (now % MLFQS_PRI_TICKS == 0 && cur != idle_thread)
+    mlfqs_update_priority (cur);
+}
+
+/* Decays T's recent_cpu by *COEF_, adds its nice value, and
+   updates its priority to match.  Skips threads whose recent_cpu
+   and nice are both 0, for which nothing would change. */
+static void
+mlfqs_decay (struct thread *t, void *coef_) 
+{
+  const fixed_t *coef = coef_;
+
+  if (t == idle_thread || (t->recent_cpu == 0 && t->nice == 0))
+    return;
+  t->recent_cpu = fix_add_int (fix_mul (*coef, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Sets T's priority from its recent_cpu and nice values, moving
+   it to the right run queue if it is ready.  Interrupts must be
+   off. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  t->base_priority = mlfqs_priority (t);
+  thread_refresh_priority (t);
+}
+
+/* Returns the MLFQS priority for T's recent_cpu and nice
+   values. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = (PRI_MAX - fix_trunc (fix_div_int (t->recent_cpu, 4))
+                  - t->nice * 2);
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
 }
 
 /* Completes a thread switch by activating the new thread's page
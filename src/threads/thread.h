@@ -5,6 +5,7 @@
 #include <list.h>
 #include <stdint.h>
 #include "synch.h"
+#include "threads/fixed-point.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -25,6 +26,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values, for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -79,10 +85,11 @@ typedef int tid_t;
 */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list, and never both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -90,15 +97,27 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority before donations. */
+    int nice;                           /* Nice value, under MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU time, under MLFQS. */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    /* Shared between thread.c and synch.c. */
+    /* Shared between thread.c, synch.c and devices/timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Shared between thread.c and synch.c, for priority donation. */
+    struct list locks;                  /* Locks held. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct semaphore *waiting_sema;     /* Semaphore being waited for, if any. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wake_tick;                  /* Tick to wake at, while sleeping. */
+
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */                   
     struct hash *supdir;                /* Supplemental page table. */
+    bool frames_closed;                 /* Frames no longer evictable (frame.c). */
     struct thread *parent;              /* Pointer to parent. */
     struct list children;               /* List of this process's children. */
     struct list_elem childelem;         /* List element for thread's parent's children list. */
@@ -108,6 +127,10 @@ struct thread
     int return_status;                  /* This thread's exit status. */
     bool success;                       /* Indicator of success/failure of child loading. */
     struct file **files;                /* Pointer to thread's page of pointers to open files. */
+    struct file *exec_file;             /* Executable, which file pages load from. */
+    struct dir *cwd;                    /* Current directory, or NULL for the root. */
+    struct list mmaps;                  /* Memory-mapped files (struct mmap_region). */
+    int next_mapid;                     /* Identifier for the next mapping. */
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
@@ -136,6 +159,8 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_refresh_priority (struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -8,6 +8,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/pte.h"
+#include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "vm/frame.h"
 #include "vm/page.h"
@@ -159,32 +160,39 @@ page_fault (struct intr_frame *f)
     if (user && not_present)
       {
         bool stack_page = fault_addr < PHYS_BASE && fault_addr >= (f->esp - 32);
-        page_in (fault_addr, f, stack_page);
+        page_in (fault_addr, f, stack_page, write);
       }
+    else if (user && write && page_unshare_zero (pg_round_down (fault_addr)))
+      return;
     else
       kill (f);
 }
 
 void
-page_in (void *fault_addr, struct intr_frame *f, bool stack_page)
+page_in (void *fault_addr, struct intr_frame *f, bool stack_page, bool write)
 {
   void *fault_page = (void *) ((uint32_t) fault_addr & PTE_ADDR);
-  struct hash *supdir = thread_current ()->supdir;
-  if (!stack_page)
-    if (!lookup_sup_page (supdir, fault_page))
-      self_destruct (-1);
-  void *frame = get_user_page (fault_page);
-  if (frame == NULL)
-    if (!(frame = evict_page (fault_page)))
-      self_destruct (-1);
-  if (stack_page)
-    {
-      memset (frame, 0, PGSIZE);
-      pagedir_set_page (thread_current ()->pagedir, fault_page, frame, true);
-    }
-  else
+  struct spte *entry = lookup_sup_page (thread_current ()->supdir, fault_page);
+  if (entry == NULL && !stack_page)
+    self_destruct (-1);
+  /* Reads of demand-zero pages share the zero frame until the
+     first write. */
+  if (!write && load_zero_page (fault_page))
+    return;
+  if (!load_shared_page (fault_page))
     {
-      load_page (fault_page, frame);
-      set_pinned (fault_page, false);
+      void *frame = get_user_page (fault_page);
+      if (frame == NULL)
+        if (!(frame = evict_page (fault_page)))
+          self_destruct (-1);
+      if (entry == NULL)
+        {
+          memset (frame, 0, PGSIZE);
+          pagedir_set_page (thread_current ()->pagedir, fault_page, frame, true);
+        }
+      else
+        load_page (fault_page, frame);
+      set_pinned (frame, false);
     }
+  page_fault_around (fault_page);
 }
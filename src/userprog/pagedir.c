@@ -43,10 +43,7 @@ pagedir_destroy (uint32_t *pd)
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P)
-            {
-              palloc_free_page (pte_get_page (*pte));
-              free_frame (pte_get_page (*pte));
-            }
+            free_frame (pte_get_page (*pte));
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -61,26 +61,6 @@ process_execute (const char *cmdline)
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create (file_name, PRI_DEFAULT, start_process, cmdline_copy);
 
-  sema_down (file_sema);
-  struct file *file = filesys_open (file_name);
-  if(file != NULL)
-    {
-      /* Disable writing to this executable. */
-      file_deny_write (file);
-      struct list_elem *e = childelem_from_tid (tid, &thread_current ()->children);
-      struct thread *child = list_entry (e, struct thread, childelem);
-      int i;
-      for (i = 2; i < 1024; i++)
-        {
-          if (child->files[i] == NULL)
-            {
-              child->files[i] = file;
-              break;
-            }
-        }
-    }
-  sema_up (file_sema);
-
   /* Done with the copy of FILE_NAME. */
   palloc_free_page (file_name);
   
@@ -106,6 +86,10 @@ start_process (void *file_name_)
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
+  /* Start in the parent's current directory.  The parent waits
+     on load_sema, so its directory cannot change under us. */
+  if (t->parent->cwd != NULL)
+    t->cwd = dir_reopen (t->parent->cwd);
   success = load (file_name, &if_.eip, &if_.esp);
   palloc_free_page (file_name);
   
@@ -186,6 +170,10 @@ process_exit (void)
      to the kernel-only page directory. */
   pd = cur->pagedir;
   close_all_files ();
+  file_close (cur->exec_file);
+  cur->exec_file = NULL;
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
 
   if (!list_empty (&cur->children))
     {
@@ -209,6 +197,7 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+      frame_owner_exit ();
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -399,7 +388,6 @@ load (const char *cmdline, void (**eip) (void), void **esp)
   process_activate ();
 
   /* Edwin driving now. */
-  sema_down (file_sema);
 
   /* Open executable file. */
   file = filesys_open (file_name);
@@ -408,6 +396,8 @@ load (const char *cmdline, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  /* Disable writing to this executable. */
+  file_deny_write (file);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -493,9 +483,15 @@ load (const char *cmdline, void (**eip) (void), void **esp)
  /* We arrive here whether the load is successful or not. */
  done:
   /* Edwin is driving */
+  if (success)
+    {
+      /* Keep the executable open, and so unwritable, until the
+         process exits: its pages are loaded from it on demand. */
+      t->exec_file = file;
+      file = NULL;
+    }
   file_close (file);
   palloc_free_page (cmdline_copy);
-  sema_up (file_sema); 
   return success;
 }
 
@@ -579,11 +575,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
       if (page_read_bytes > 0)
         {
-          uint8_t location = (page_read_bytes == 0) ? 1 : 3;
-          struct inode *inode = file_get_inode (file);
-          ASSERT (inode != NULL);
-          uint32_t sector = byte_to_sector (inode, ofs);
-          supdir_set_page (thread_current ()->supdir, upage, sector, page_read_bytes, location, writable);
+          supdir_set_file (thread_current ()->supdir, upage, file, ofs, page_read_bytes, FILE_SYS, writable);
         }
       else
         {
@@ -614,6 +606,7 @@ setup_stack (const char *cmdline, void **esp)
         frame = evict_page (stack_addr);
       ASSERT (frame != NULL);
       success = load_page (stack_addr, frame);
+      set_pinned (frame, false);
     }
   if (success)
     {
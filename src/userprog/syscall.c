@@ -1,5 +1,6 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <console.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
@@ -13,12 +14,21 @@
 #include "threads/malloc.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
 #include "devices/input.h"
 #include <string.h>
+#include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/mmap.h"
+
+/* Bytes of a console write copied and output at a time.  Writes
+   up to this long are never mixed with other writers' output. */
+#define CONSOLE_CHUNK 256
 
 static void syscall_handler (struct intr_frame *);
 static bool is_pt_valid (const void *pt, struct intr_frame *f, bool stack_page);
+static bool is_pt_writable (const void *pt);
 static bool process_args (int *esp, int argc, int ptr_pos, struct intr_frame *f);
 static void sys_halt (void);
 static void sys_exit (int status, struct intr_frame *f);
@@ -33,6 +43,13 @@ static void sys_remove (const char *file_name, struct intr_frame *f);
 static void sys_read (int fd, void *buffer, unsigned size, struct intr_frame *f);
 static void sys_seek (int fd, unsigned position);
 static void sys_tell (int fd, struct intr_frame *f);
+static void sys_mmap (int fd, void *addr, struct intr_frame *f);
+static void sys_munmap (mapid_t mapping);
+static void sys_chdir (const char *dir, struct intr_frame *f);
+static void sys_mkdir (const char *dir, struct intr_frame *f);
+static void sys_readdir (int fd, char *name, struct intr_frame *f);
+static void sys_isdir (int fd, struct intr_frame *f);
+static void sys_inumber (int fd, struct intr_frame *f);
 
 /* These defined constants are used in process_args to indicate position of pointer in argument list. */
 #define NO_PT 0
@@ -42,8 +59,6 @@ static void sys_tell (int fd, struct intr_frame *f);
 void
 syscall_init (void) 
 {
-  file_sema = malloc (sizeof (struct semaphore));
-  sema_init (file_sema, 1);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -109,6 +124,34 @@ syscall_handler (struct intr_frame *f)
           if (process_args (esp_int, 1, NO_PT, f))
             sys_tell (esp_int[0], f);
           break;
+        case SYS_MMAP:
+          if (process_args (esp_int, 2, NO_PT, f))
+            sys_mmap (esp_int[0], (void *)esp_int[1], f);
+          break;
+        case SYS_MUNMAP:
+          if (process_args (esp_int, 1, NO_PT, f))
+            sys_munmap ((mapid_t)esp_int[0]);
+          break;
+        case SYS_CHDIR:
+          if (process_args (esp_int, 1, FIRST_PT, f))
+            sys_chdir ((const char *)esp_int[0], f);
+          break;
+        case SYS_MKDIR:
+          if (process_args (esp_int, 1, FIRST_PT, f))
+            sys_mkdir ((const char *)esp_int[0], f);
+          break;
+        case SYS_READDIR:
+          if (process_args (esp_int, 2, SECOND_PT, f))
+            sys_readdir (esp_int[0], (char *)esp_int[1], f);
+          break;
+        case SYS_ISDIR:
+          if (process_args (esp_int, 1, NO_PT, f))
+            sys_isdir (esp_int[0], f);
+          break;
+        case SYS_INUMBER:
+          if (process_args (esp_int, 1, NO_PT, f))
+            sys_inumber (esp_int[0], f);
+          break;
         default:
           sys_exit (-1, f);
           break;
@@ -153,11 +196,24 @@ is_pt_valid (const void *pt, struct intr_frame *f, bool allow_stack_growth)
   else if (pagedir_get_page (thread_current ()->pagedir, pt) == NULL)
     {
       bool stack_page = allow_stack_growth ? (pt < PHYS_BASE && pt >= (f->esp - 32)) : false;
-      page_in ((void *)pt, f, stack_page);
+      page_in ((void *)pt, f, stack_page, false);
     }
   return true;
 }
 
+/* Helper function to check whether the user page containing the valid, mapped pointer PT
+   may be written by the kernel on the process's behalf. A writable page still mapped to
+   the shared zero frame first gets a frame of its own, since the kernel cannot fault
+   it in on write. */
+static bool
+is_pt_writable (const void *pt)
+{
+  uint32_t *pte;
+  page_unshare_zero (pg_round_down (pt));
+  pte = lookup_page (thread_current ()->pagedir, pt, false);
+  return pte != NULL && (*pte & PTE_W) != 0;
+}
+
 /* Helper function that is used in syscall.c, process.c, and exception.c to close all
    of the current process's open files and then free the page that contained the file
    pointers. */
@@ -252,6 +308,8 @@ self_destruct (int status)
           child->parent = NULL;
         }
     }
+  frame_owner_exit ();
+  mmap_unmap_all ();
   supdir_destroy (t->supdir);
   printf ("%s: exit(%d)\n", thread_current ()->name, status);
   thread_exit ();
@@ -273,7 +331,6 @@ static void
 sys_open (const char *file_name, struct intr_frame *f)
 {
   /* Edwin is driving. */
-  sema_down (file_sema);
   f->eax = -1;
   struct thread *t = thread_current ();
   int i;
@@ -290,12 +347,11 @@ sys_open (const char *file_name, struct intr_frame *f)
             }
         }
     }
-  sema_up (file_sema);
 }
 
 /* Attempts to write the contents of BUFFER into the file denoted by the given file descriptor.
-   If file descriptor 1 is given, this function uses putbuf to write the buffer to stdout, 300
-   bytes at a time. This function returns -1 if there is an error in writing. */
+   If file descriptor 1 is given, this function uses putbuf to write the buffer to stdout,
+   CONSOLE_CHUNK bytes at a time. This function returns -1 if there is an error in writing. */
 static void 
 sys_write (int fd, const void *buffer, unsigned size, struct intr_frame *f)
 {
@@ -304,34 +360,36 @@ sys_write (int fd, const void *buffer, unsigned size, struct intr_frame *f)
   struct thread *t = thread_current ();
   if (fd == 1)
     {
+      const char *char_buffer = buffer;
+      const void *buffer_;
+      char chunk_buf[CONSOLE_CHUNK];
       unsigned pos;
-      int bytes_left = size;
-      char *char_buffer = (char *)buffer;
-      /* Write the buffer to stdout, 300 bytes at a time. */
-      for (pos = 0; pos < size; pos += 300)
+      for (buffer_ = (void *) ((uint32_t) buffer & 0xfffff000); (unsigned) buffer_ < (unsigned) buffer + size; buffer_ += PGSIZE)
+        is_pt_valid (buffer_, f, true);
+      /* Copy the buffer out in chunks and write each copy to stdout.  No
+         console lock is held while pinning, which may page in, evict, or kill the
+         process; putbuf keeps each chunk unmixed with other writers' output. */
+      for (pos = 0; pos < size; pos += CONSOLE_CHUNK)
         {
-          char_buffer += pos;
-          if (is_pt_valid (char_buffer, f, true))
-            {
-              if (bytes_left > 300)
-                {
-                  putbuf (buffer, 300);
-                  bytes_left -= 300;
-                }
-              else
-                {
-                  putbuf (buffer, bytes_left);
-                  bytes_left = 0;
-                }
-            }
+          unsigned chunk = size - pos < CONSOLE_CHUNK ? size - pos : CONSOLE_CHUNK;
+          page_pin_range (char_buffer + pos, chunk, false);
+          memcpy (chunk_buf, char_buffer + pos, chunk);
+          page_unpin_range (char_buffer + pos, chunk);
+          putbuf (chunk_buf, chunk);
         }
       f->eax = size;
     }
-  else if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
+  else if (fd < 1024 && fd >= 2 && (file = t->files[fd])
+           && !inode_is_dir (file_get_inode (file)))
   {
-    sema_down (file_sema);
+    const void *buffer_;
+    for (buffer_ = (void *) ((uint32_t) buffer & 0xfffff000); (unsigned) buffer_ < (unsigned) buffer + size; buffer_ += PGSIZE)
+      is_pt_valid (buffer_, f, true);
+    /* Pin the buffer so that the file system writes straight from it
+       without faulting while holding the file's locks. */
+    page_pin_range (buffer, size, false);
     f->eax = (int)file_write (file, buffer, size);
-    sema_up (file_sema);
+    page_unpin_range (buffer, size);
   }
   else
     f->eax = -1;
@@ -343,13 +401,11 @@ static void
 sys_filesize (int fd, struct intr_frame *f)
 {
   /* Edwin is driving. */
-  sema_down (file_sema);
   f->eax = -1;
   struct thread *t = thread_current ();
   struct file *file;
   if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
     f->eax = file_length (file);
-  sema_up (file_sema);
 }
 
 /* Closes the file denoted by the given file descriptor, if such an open files exists. */
@@ -357,7 +413,6 @@ static void
 sys_close (int fd)
 {
   /* Heather is driving. */
-  sema_down (file_sema);
   struct thread *t = thread_current ();
   struct file *file;
   if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
@@ -365,7 +420,6 @@ sys_close (int fd)
     file_close (file);
     t->files[fd] = NULL;
   }
-  sema_up (file_sema);
 }
 
 /* Creates a file called file_name that is of size initial_size. Returns true
@@ -374,9 +428,7 @@ static void
 sys_create (const char *file_name, unsigned initial_size, struct intr_frame *f)
 {
   /* Edwin is driving. */
-  sema_down (file_sema);
   f->eax = filesys_create (file_name, initial_size);
-  sema_up (file_sema);
 }
 
 /* Deletes the file called file_name. Returns true if successful, false otherwise.
@@ -385,14 +437,14 @@ static void
 sys_remove (const char *file_name, struct intr_frame *f)
 {
   /* Heather is driving. */
-  sema_down (file_sema);
   f->eax = filesys_remove (file_name);
-  sema_up (file_sema);
 }
 
 /* Attempts to read the contents of the file denoted by the given file descriptor into BUFFER.
-   If file descriptor 0 is given, this function uses input_getc to read from the keyboard, one
-   byte at a time. This function returns -1 if there is an error in reading. */
+   If file descriptor 0 is given, this function uses input_getbuf to read from the keyboard, as
+   many bytes at a time as are waiting, and returns once at least one byte has been read and no
+   more are waiting or a newline has been read. This function returns -1 if there is an error
+   in reading. */
 static void
 sys_read (int fd, void *buffer, unsigned size, struct intr_frame *f)
 {
@@ -402,35 +454,48 @@ sys_read (int fd, void *buffer, unsigned size, struct intr_frame *f)
   if (fd == 0)
     {
       uint8_t *byte_buffer = (uint8_t *)buffer;
-      int bytes_read = 0;
-      unsigned i;
-      uint32_t *pd = t->pagedir;
-      for (i = 0; i < size; i++)
+      void *buffer_;
+      unsigned pos = 0;
+      for (buffer_ = (void *) ((uint32_t) buffer & 0xfffff000); (unsigned) buffer_ < (unsigned) buffer + size; buffer_ += PGSIZE)
         {
-          if (is_pt_valid (byte_buffer, f, true))
-            {
-              bool writable = *(lookup_page (pd, byte_buffer, false)) & PTE_W;
-              if (!writable)
-                self_destruct (-1);
-              *byte_buffer = input_getc ();
-              byte_buffer++;
-              bytes_read++;
-            }
+          if (!is_pt_valid (buffer_, f, true) || !is_pt_writable (buffer_))
+            self_destruct (-1);
         }
-      f->eax = bytes_read;
+      /* Move the queued input that fits straight into the buffer, pinning only
+         the page being filled.  Sleep, unpinned, only until the first byte
+         arrives; return once the queue runs dry or a line is complete. */
+      while (pos < size)
+        {
+          unsigned chunk = PGSIZE - pg_ofs (byte_buffer + pos), got;
+          bool newline;
+          if (chunk > size - pos)
+            chunk = size - pos;
+          if (pos == 0)
+            input_wait ();
+          page_pin_range (byte_buffer + pos, chunk, true);
+          got = input_getbuf (byte_buffer + pos, chunk);
+          newline = memchr (byte_buffer + pos, '\n', got) != NULL;
+          page_unpin_range (byte_buffer + pos, chunk);
+          pos += got;
+          if (pos > 0 && (got < chunk || newline))
+            break;
+        }
+      f->eax = pos;
     }
-  else if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
+  else if (fd < 1024 && fd >= 2 && (file = t->files[fd])
+           && !inode_is_dir (file_get_inode (file)))
   {
     void *buffer_;
-    uint32_t *pd = t->pagedir;
     for (buffer_ = (void *) ((uint32_t) buffer & 0xfffff000); (unsigned) buffer_ < (unsigned) buffer + size; buffer_ += PGSIZE)
     {
-      if (!is_pt_valid (buffer_, f, true) || !(*(lookup_page (pd, buffer_, false)) & PTE_W))
+      if (!is_pt_valid (buffer_, f, true) || !is_pt_writable (buffer_))
         self_destruct (-1);
     }
-    sema_down (file_sema);
+    /* Pin the buffer so that the file system reads straight into it
+       without faulting while holding the file's locks. */
+    page_pin_range (buffer, size, true);
     f->eax = (int)file_read (file, buffer, size);
-    sema_up (file_sema);
+    page_unpin_range (buffer, size);
   }
   else
     f->eax = -1;
@@ -442,12 +507,10 @@ static void
 sys_seek (int fd, unsigned position)
 {
   /* Heather is driving. */
-  sema_down (file_sema);
   struct file *file;
   struct thread *t = thread_current ();
   if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
     file_seek (file, position);
-  sema_up (file_sema);
 }
 
 /* Uses file function file_tell to return the next byte to be read or written in the file
@@ -456,11 +519,101 @@ static void
 sys_tell (int fd, struct intr_frame *f)
 {
   /* Edwin is driving. */
-  sema_down (file_sema);
   f->eax = -1;
   struct thread *t = thread_current ();
   struct file *file;
   if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
     f->eax = file_tell (file);
-  sema_up (file_sema);
+}
+
+/* Maps the file denoted by the given file descriptor into memory at ADDR, returning the
+   new mapping's identifier, or -1 if the file descriptor is not an open file or the file
+   cannot be mapped there. The pages are read in lazily as they are touched. */
+static void
+sys_mmap (int fd, void *addr, struct intr_frame *f)
+{
+  struct file *file;
+  struct thread *t = thread_current ();
+  f->eax = MAP_FAILED;
+  if (fd < 1024 && fd >= 2 && (file = t->files[fd])
+      && !inode_is_dir (file_get_inode (file)))
+    f->eax = mmap_map (file, addr);
+}
+
+/* Unmaps the mapping denoted by MAPPING, writing pages that were modified back to the
+   file. Does nothing if MAPPING is not one of this process's mappings. */
+static void
+sys_munmap (mapid_t mapping)
+{
+  mmap_unmap (mapping);
+}
+
+/* Changes the current directory to DIR, a relative or absolute path. Returns true
+   if successful, false otherwise. */
+static void
+sys_chdir (const char *dir, struct intr_frame *f)
+{
+  f->eax = filesys_chdir (dir);
+}
+
+/* Creates the directory DIR, a relative or absolute path. Returns true if successful,
+   false if DIR already exists or a directory along its path does not. */
+static void
+sys_mkdir (const char *dir, struct intr_frame *f)
+{
+  f->eax = filesys_mkdir (dir);
+}
+
+/* Reads the next entry of the directory denoted by the given file descriptor into NAME,
+   which must have room for NAME_MAX + 1 bytes, and returns true, or returns false if there
+   are no more entries or FD is not a directory. The file's position tracks the next entry;
+   "." and ".." are never returned. */
+static void
+sys_readdir (int fd, char *name, struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct file *file;
+  char entry[NAME_MAX + 1];
+  f->eax = false;
+  if (fd < 1024 && fd >= 2 && (file = t->files[fd])
+      && inode_is_dir (file_get_inode (file)))
+    {
+      off_t pos = file_tell (file);
+      if (!is_pt_valid (name + NAME_MAX, f, true)
+          || !is_pt_writable (name) || !is_pt_writable (name + NAME_MAX))
+        self_destruct (-1);
+      if (dir_readdir_at (file_get_inode (file), &pos, entry))
+        {
+          size_t len = strlen (entry) + 1;
+          page_pin_range (name, len, true);
+          memcpy (name, entry, len);
+          page_unpin_range (name, len);
+          f->eax = true;
+        }
+      file_seek (file, pos);
+    }
+}
+
+/* Returns true if the given file descriptor denotes a directory, false if it denotes
+   an ordinary file or no open file. */
+static void
+sys_isdir (int fd, struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct file *file;
+  f->eax = false;
+  if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
+    f->eax = inode_is_dir (file_get_inode (file));
+}
+
+/* Returns the inode number of the file or directory denoted by the given file
+   descriptor, which is the sector of its inode, or -1 if there is no such open file. */
+static void
+sys_inumber (int fd, struct intr_frame *f)
+{
+  struct thread *t = thread_current ();
+  struct file *file;
+  f->eax = -1;
+  if (fd < 1024 && fd >= 2 && (file = t->files[fd]))
+    f->eax = inode_get_inumber (file_get_inode (file));
 }
@@ -10,147 +10,700 @@
 #include "threads/pte.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
-#include "threads/vaddr.h" 
+#include "threads/vaddr.h"
 #include "threads/thread.h"
+#include "threads/interrupt.h"
 #include "devices/block.h"
 
-static struct hash *ft;
-unsigned frame_hash (const struct hash_elem *e, void *aux UNUSED);
-bool frame_less_than (const struct hash_elem *elem_a, const struct hash_elem *elem_b, void *aux UNUSED);
-static struct semaphore *ft_sema;
-static int *it_count;
+/* Free frame watermarks for the pageout thread. */
+#define PAGEOUT_LOW_WATER 8         /* Wake pageout below this many. */
+#define PAGEOUT_HIGH_WATER 16       /* Pageout refills up to this many. */
 
-void 
+/* Frame table, one entry per frame of the user pool. */
+static struct ft_entry *frames;
+static size_t frame_cnt;
+
+/* Next frame the clock hand will consider for eviction. */
+static size_t clock_hand;
+
+/* Serializes evictions, which share the clock hand.  Everything
+   else about a frame is guarded by that entry's pin_sema. */
+static struct semaphore ft_sema;
+
+/* Free frames left in the user pool. */
+static size_t free_cnt;
+
+/* Shared read-only frame of zeros, taken from the kernel pool,
+   that stands in for demand-zero pages until they are written. */
+static void *zero_frame;
+
+/* Shared page cache: frames holding read-only file pages, keyed
+   by the page's first sector on disk and the number of bytes read
+   from the file (the rest being zeros), so that processes running
+   the same executable map one copy of its code.  Guarded by
+   share_sema, which may be acquired while holding an entry's
+   pin_sema but not the other way around. */
+static struct hash share_cache;
+static struct semaphore share_sema;
+
+/* Mapping of a shared frame by a process other than its owner.
+   The sharer's page directory cannot be freed while the mapping
+   exists, because freeing it first unmaps the frame through
+   free_frame, which waits for the entry's pin_sema. */
+struct frame_map
+{
+	struct thread *thread;        /* Sharing process. */
+	uint32_t *pagedir;            /* Its page directory. */
+	void *vaddr;                  /* Its virtual address for the frame. */
+	struct list_elem elem;        /* Element in ft_entry's sharers. */
+};
+
+/* Wakes up the pageout thread. */
+static struct semaphore pageout_sema;
+
+/* Eviction statistics. */
+static unsigned long long evict_cnt;          /* Frames evicted. */
+static unsigned long long second_chance_cnt;  /* Frames skipped for being accessed. */
+static unsigned long long dirty_victim_cnt;   /* Victims written to swap. */
+static unsigned long long mmap_victim_cnt;    /* Victims written back to their file. */
+static unsigned long long clean_file_cnt;     /* Clean victims reloadable from file. */
+static unsigned long long clean_swap_cnt;     /* Clean victims still held in swap. */
+static unsigned long long clean_zero_cnt;     /* Clean victims that are all zeros. */
+static unsigned long long pageout_cnt;        /* Frames freed by pageout. */
+static unsigned long long share_hit_cnt;      /* Faults served from share_cache. */
+
+/* Read-ahead statistics, for swap read-ahead and fault-around. */
+static unsigned long long readahead_cnt;      /* Pages read ahead. */
+static unsigned long long readahead_hit_cnt;  /* ...later accessed. */
+static unsigned long long readahead_miss_cnt; /* ...evicted unaccessed. */
+
+/* A frame chosen for eviction, unmapped from its owner but not
+   yet written out.  Until victim_release, the owner cannot get
+   past frame_owner_exit, so its supplemental page table stays
+   valid. */
+struct victim
+{
+	struct ft_entry *entry;       /* Frame table entry, pinned. */
+	struct thread *thread;        /* Owner of the page. */
+	void *upage;                  /* Owner's virtual address. */
+	void *kpage;                  /* Frame's kernel address. */
+	struct spte *spte;            /* Owner's supplemental entry, if any. */
+	bool dirty;                   /* Must be written to swap? */
+};
+
+static struct ft_entry *frame_lookup (const void *kpage);
+static void *frame_kpage (const struct ft_entry *);
+static bool frame_test_accessed (struct ft_entry *);
+static void frame_unshare (struct ft_entry *);
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static bool clock_select (struct victim *);
+static bool victim_needs_slot (const struct victim *);
+static void victim_swapped (struct victim *, size_t sector);
+static void victim_release (struct victim *);
+static void sort_victims (struct victim[], size_t cnt);
+static void pageout (void *aux);
+static size_t free_cnt_adjust (int delta);
+static void wait_evictions (const void *upage);
+
+void
 frame_table_init ()
 {
 	/* Scott was driving */
-	ft = malloc (sizeof (struct hash));
-	hash_init (ft, (hash_hash_func *) frame_hash, (hash_less_func *) frame_less_than, NULL);
-	it_count = malloc (sizeof (int));
-	*it_count = 1;
-	ft_sema = malloc (sizeof (struct semaphore));
-	sema_init (ft_sema, 1);
+	size_t i;
+
+	frame_cnt = palloc_user_page_cnt ();
+	frames = malloc (frame_cnt * sizeof *frames);
+	if (frames == NULL)
+		PANIC ("frame_table_init: out of memory");
+	for (i = 0; i < frame_cnt; i++)
+		{
+			frames[i].thread = NULL;
+			frames[i].vaddr = 0;
+			frames[i].prefetched = false;
+			frames[i].evicting = false;
+			frames[i].shared = false;
+			list_init (&frames[i].sharers);
+			sema_init (&frames[i].pin_sema, 1);
+		}
+	hash_init (&share_cache, share_hash, share_less, NULL);
+	sema_init (&share_sema, 1);
+	clock_hand = 0;
+	free_cnt = frame_cnt;
+	sema_init (&ft_sema, 1);
+	sema_init (&pageout_sema, 0);
+	zero_frame = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	thread_create ("pageout", PRI_DEFAULT, pageout, NULL);
 }
 
+/* Obtains a free user frame for VADDR in the current thread.
+   The frame is returned pinned; the caller unpins it with
+   set_pinned once the page has been mapped.  The frame's
+   contents are undefined; every caller fills it in.  Returns a
+   null pointer if the user pool is exhausted. */
 void *
 get_user_page (uint8_t *vaddr)
 {
 	void *page;
-	if (!(page = palloc_get_page (PAL_USER | PAL_ZERO)))
+	if (!(page = palloc_get_page (PAL_USER)))
 		return page;
-	struct ft_entry *entry = malloc (sizeof (struct ft_entry));
+	struct ft_entry *entry = frame_lookup (page);
+	sema_down (&entry->pin_sema);
 	entry->vaddr = (uint32_t) vaddr;
 	entry->thread = thread_current ();
-	sema_init (&entry->pin_sema, 1);
-	sema_down (ft_sema);
-	hash_replace (ft, &entry->elem);
-	sema_up (ft_sema);
+	entry->prefetched = false;
+	if (free_cnt_adjust (-1) < PAGEOUT_LOW_WATER)
+		sema_up (&pageout_sema);
 	return page;
 }
 
-/* evict a page using TBD */
+/* Like get_user_page, but for speculatively reading VADDR ahead
+   of a fault: succeeds only while more than PAGEOUT_LOW_WATER
+   frames are free, so read-ahead never forces an eviction, and
+   marks the frame so that read-ahead hits and misses are
+   counted. */
+void *
+get_readahead_page (uint8_t *vaddr)
+{
+	void *page;
+	if (free_cnt_adjust (0) <= PAGEOUT_LOW_WATER
+	    || !(page = get_user_page (vaddr)))
+		return NULL;
+	frame_lookup (page)->prefetched = true;
+	readahead_cnt++;
+	return page;
+}
+
+/* Hands a frame to NEW_ADDR in the current thread by evicting
+   one synchronously.  Used when the pageout thread has not kept
+   up and the user pool is empty.  The frame is returned pinned.
+   Returns a null pointer if no frame could be evicted. */
 void *
 evict_page (uint8_t *new_addr)
 {
 	/* Stephanie was driving */
-	sema_down (ft_sema);
-	struct hash_iterator iterator;
-	hash_first (&iterator, ft);
-	struct hash_elem *e = hash_next (&iterator);
-	struct ft_entry *entry = hash_entry (e, struct ft_entry, elem);
+	struct victim v;
 
-	while (!sema_try_down (&entry->pin_sema))
+	if (!clock_select (&v))
+		return NULL;
+	if (v.dirty && v.spte != NULL && v.spte->location == MMAP_SYS)
+		page_write_back (v.spte, v.kpage);
+	else if (v.dirty && v.spte != NULL && v.spte->location == SWAP_SYS)
+		swap_rewrite (v.spte->sector, v.kpage);
+	else if (v.dirty)
+		victim_swapped (&v, swap_write (v.kpage));
+	victim_release (&v);
+
+	v.entry->thread = thread_current ();
+	v.entry->vaddr = (uint32_t) new_addr;
+	return v.kpage;
+}
+
+/* Picks a victim frame with the clock (second chance) algorithm
+   and unmaps it, filling in V.  Frames whose accessed bit is set
+   get the bit cleared and are passed over once.  Only the sweep
+   holds ft_sema; the victim is left pinned, and marked as being
+   evicted so that its owner waits for it before exiting, so that
+   it can be written out without ft_sema.  Returns false if every
+   frame stayed pinned through two full sweeps. */
+static bool
+clock_select (struct victim *v)
+{
+	struct ft_entry *entry = NULL;
+	struct thread *victim = NULL;
+	void *old_addr = NULL;
+	uint32_t *pd;
+	size_t scanned;
+
+	sema_down (&ft_sema);
+	for (scanned = 0; scanned < 2 * frame_cnt; scanned++)
+		{
+			entry = &frames[clock_hand];
+			clock_hand = (clock_hand + 1) % frame_cnt;
+
+			if (!sema_try_down (&entry->pin_sema))
+				continue;
+
+			victim = entry->thread;
+			old_addr = (void *) entry->vaddr;
+			if (victim == NULL || victim->frames_closed)
+				{
+					/* Frame is free or its owner is tearing down its
+					   address space. */
+					sema_up (&entry->pin_sema);
+					victim = NULL;
+					continue;
+				}
+			if (frame_test_accessed (entry))
+				{
+					if (entry->prefetched)
+						{
+							entry->prefetched = false;
+							readahead_hit_cnt++;
+						}
+					sema_up (&entry->pin_sema);
+					second_chance_cnt++;
+					victim = NULL;
+					continue;
+				}
+			entry->evicting = true;
+			break;
+		}
+	sema_up (&ft_sema);
+	if (victim == NULL)
+		return false;
+	if (entry->prefetched)
 		{
-			struct hash_elem *e = hash_next (&iterator);
-			entry = hash_entry (e, struct ft_entry, elem);
+			entry->prefetched = false;
+			readahead_miss_cnt++;
 		}
-	struct thread *victim = entry->thread;
-	void *old_addr = (void *) entry->vaddr;
-	void *frame_addr = pagedir_get_page (victim->pagedir, old_addr);
-	struct spte *spte = lookup_sup_page (victim->supdir, old_addr);
-	if (pagedir_is_dirty (victim->pagedir, old_addr) || spte->location == SWAP_SYS)
+
+	pd = victim->pagedir;
+	v->entry = entry;
+	v->thread = victim;
+	v->upage = old_addr;
+	v->kpage = frame_kpage (entry);
+	v->spte = lookup_sup_page (victim->supdir, old_addr);
+	v->dirty = pagedir_is_dirty (pd, old_addr);
+
+	/* Unmap first so the owner faults rather than writing to the
+	   frame while it is being saved. */
+	pagedir_clear_page (pd, old_addr);
+	frame_unshare (entry);
+	return true;
+}
+
+/* Returns true if V must be written to a newly allocated swap
+   slot: it is dirty, and neither has a slot already nor is
+   written back to a mapped file. */
+static bool
+victim_needs_slot (const struct victim *v)
+{
+	return v->dirty
+	       && (v->spte == NULL
+	           || (v->spte->location != SWAP_SYS && v->spte->location != MMAP_SYS));
+}
+
+/* Records that dirty victim V now lives in swap at SECTOR. */
+static void
+victim_swapped (struct victim *v, size_t sector)
+{
+	if (sector == SWAP_ERROR)
+		PANIC ("evict_page: out of swap space");
+	if (!supdir_set_swap (v->thread->supdir, v->upage, sector))
+		supdir_set_page (v->thread->supdir, v->upage, sector, PGSIZE, SWAP_SYS, true);
+}
+
+/* Finishes evicting V, which must already have been written out
+   if dirty, and detaches it from its owner.  The frame stays
+   pinned.
+
+   Only dirty pages need writing.  A clean page can be dropped:
+   file pages reload from the executable or mapped file, zero
+   pages are zeroed again, and swapped-in pages keep their swap
+   slot, which still holds an identical copy. */
+static void
+victim_release (struct victim *v)
+{
+	if (v->dirty && v->spte != NULL && v->spte->location == MMAP_SYS)
+		mmap_victim_cnt++;
+	else if (v->dirty)
+		dirty_victim_cnt++;
+	else if (v->spte != NULL
+	         && (v->spte->location == FILE_SYS || v->spte->location == MMAP_SYS))
+		clean_file_cnt++;
+	else if (v->spte != NULL && v->spte->location == SWAP_SYS)
+		clean_swap_cnt++;
+	else
+		clean_zero_cnt++;
+	evict_cnt++;
+	v->entry->thread = NULL;
+	v->entry->evicting = false;
+}
+
+/* Pageout thread.  Sleeps until the number of free user frames
+   drops below PAGEOUT_LOW_WATER, then evicts frames back into the
+   user pool until PAGEOUT_HIGH_WATER are free, so that faulting
+   processes normally find a free frame without writing to swap
+   themselves.  Victims are gathered up to SWAP_BATCH_MAX at a
+   time, and those needing a new swap slot are written together so
+   that they go to disk as one sequential transfer. */
+static void
+pageout (void *aux UNUSED)
+{
+	struct victim victims[SWAP_BATCH_MAX];
+	void *batch[SWAP_BATCH_MAX];
+	size_t sectors[SWAP_BATCH_MAX];
+
+	for (;;)
 		{
-			block_sector_t sector = swap_write (frame_addr);
-			supdir_set_swap (victim->supdir, old_addr, sector);
+			sema_down (&pageout_sema);
+			while (free_cnt_adjust (0) < PAGEOUT_HIGH_WATER)
+				{
+					size_t want = PAGEOUT_HIGH_WATER - free_cnt_adjust (0);
+					size_t cnt, batch_cnt = 0, i;
+
+					if (want > SWAP_BATCH_MAX)
+						want = SWAP_BATCH_MAX;
+					for (cnt = 0; cnt < want; cnt++)
+						if (!clock_select (&victims[cnt]))
+							break;
+					if (cnt == 0)
+						break;
+					sort_victims (victims, cnt);
+
+					/* Dirty mapped pages go back to their file and dirty
+					   pages that already own a slot go back to it; the
+					   rest are written as a batch. */
+					for (i = 0; i < cnt; i++)
+						{
+							struct victim *v = &victims[i];
+							if (victim_needs_slot (v))
+								batch[batch_cnt++] = v->kpage;
+							else if (v->dirty && v->spte->location == MMAP_SYS)
+								page_write_back (v->spte, v->kpage);
+							else if (v->dirty)
+								swap_rewrite (v->spte->sector, v->kpage);
+						}
+					swap_write_batch (batch, batch_cnt, sectors);
+					for (i = 0, batch_cnt = 0; i < cnt; i++)
+						{
+							struct victim *v = &victims[i];
+							if (victim_needs_slot (v))
+								victim_swapped (v, sectors[batch_cnt++]);
+							victim_release (v);
+							sema_up (&v->entry->pin_sema);
+							palloc_free_page (v->kpage);
+							free_cnt_adjust (1);
+							pageout_cnt++;
+						}
+				}
 		}
-	pagedir_clear_page (victim->pagedir, old_addr);
-	hash_delete (ft, e);
-	entry->thread = thread_current ();
-	entry->vaddr = (uint32_t) new_addr;
-	hash_replace (ft, e);
-	sema_up (ft_sema);
-	return frame_addr;
 }
 
-void
-free_frame (void *vaddr)
+/* Sorts the CNT victims in V by owner and then by virtual
+   address, so that a batch written with swap_write_batch puts
+   each process's neighbouring pages in neighbouring slots, where
+   swap read-ahead can find them. */
+static void
+sort_victims (struct victim v[], size_t cnt)
 {
-	struct thread *t = thread_current ();
-	struct ft_entry entry;
-	struct hash_elem *del_elem;
-	struct ft_entry *remove_entry;
-	//find entry in frame table.
-	entry.vaddr = (uint32_t) vaddr;
-	entry.thread = t;
-	sema_down (ft_sema);
-	del_elem =	hash_find (ft, &entry.elem);
-	if (del_elem != NULL)
+	size_t i, j;
+
+	for (i = 1; i < cnt; i++)
 		{
-			remove_entry = hash_entry (del_elem, struct ft_entry, elem);
-			hash_delete (ft, del_elem);
-			free (remove_entry);
+			struct victim tmp = v[i];
+			for (j = i; j > 0; j--)
+				{
+					struct victim *prev = &v[j - 1];
+					if (prev->thread < tmp.thread
+					    || (prev->thread == tmp.thread && prev->upage < tmp.upage))
+						break;
+					v[j] = *prev;
+				}
+			v[j] = tmp;
 		}
-	sema_up (ft_sema);
 }
 
-void
-frame_table_destroy ()
+/* Adds DELTA to the count of free user frames and returns the new
+   count. */
+static size_t
+free_cnt_adjust (int delta)
+{
+	enum intr_level old_level = intr_disable ();
+	size_t cnt = free_cnt += delta;
+	intr_set_level (old_level);
+	return cnt;
+}
+
+/* Returns the shared zero frame.  It is never evicted or freed,
+   and must only be mapped read-only. */
+void *
+frame_zero_page (void)
 {
-	sema_down (ft_sema);
-	hash_destroy (ft, NULL);
-  free (ft);
-  sema_up (ft_sema);
+	return zero_frame;
 }
 
+/* Releases user frame KPAGE back to the user pool if it still
+   belongs to the current thread and no other process shares it;
+   otherwise just drops the current thread's mapping.  The shared
+   zero frame is ignored. */
 void
-set_pinned (void *vaddr, bool set)
-{
-	sema_down (ft_sema);
-	struct thread *t = thread_current ();
-	struct ft_entry entry;
-	entry.vaddr = (uint32_t) vaddr;
-	entry.thread = t;
-	struct ft_entry *pin_entry = hash_entry (hash_find (ft, &entry.elem), struct ft_entry, elem);
-	sema_up (ft_sema);
-	if (pin_entry != NULL)
-		{
-			if (set)
-				sema_down (&pin_entry->pin_sema);
-			else
+free_frame (void *kpage)
+{
+	struct ft_entry *entry;
+	bool owned;
+
+	if (kpage == zero_frame)
+		return;
+	entry = frame_lookup (kpage);
+
+	/* Wait for an eviction of this frame to finish. */
+	sema_down (&entry->pin_sema);
+	owned = entry->thread == thread_current ();
+	if (owned && !list_empty (&entry->sharers))
+		{
+			/* Hand the frame to one of the processes sharing it. */
+			struct frame_map *map = list_entry (list_pop_front (&entry->sharers),
+			                                    struct frame_map, elem);
+			entry->thread = map->thread;
+			entry->vaddr = (uint32_t) map->vaddr;
+			free (map);
+			owned = false;
+		}
+	else if (owned)
+		{
+			frame_unshare (entry);
+			entry->thread = NULL;
+		}
+	else
+		{
+			struct list_elem *e;
+			for (e = list_begin (&entry->sharers); e != list_end (&entry->sharers);
+			     e = list_next (e))
 				{
-					sema_try_down (&pin_entry->pin_sema);
-					sema_up (&pin_entry->pin_sema);
+					struct frame_map *map = list_entry (e, struct frame_map, elem);
+					if (map->thread == thread_current ())
+						{
+							list_remove (e);
+							free (map);
+							break;
+						}
 				}
-		}	
+		}
+	sema_up (&entry->pin_sema);
+	if (owned)
+		{
+			palloc_free_page (kpage);
+			free_cnt_adjust (1);
+		}
+}
+
+/* Keeps the frames of the current process, which is exiting,
+   from being chosen for eviction from now on, and waits for the
+   evictions of its frames already under way to finish with its
+   page directory and supplemental page table, so that they can
+   be torn down.  Frames the process has pinned itself are not
+   waited for. */
+void
+frame_owner_exit (void)
+{
+	struct thread *cur = thread_current ();
+
+	if (cur->frames_closed)
+		return;
+	sema_down (&ft_sema);
+	cur->frames_closed = true;
+	sema_up (&ft_sema);
+	wait_evictions (NULL);
+}
+
+/* Waits for an eviction under way of the current thread's page
+   UPAGE, which has already unmapped the page, to finish writing
+   it out through its supplemental entry, so that the entry and
+   any file it refers to can be freed. */
+void
+frame_wait_eviction (const void *upage)
+{
+	wait_evictions (upage);
 }
 
-/* Returns a hash value for entry e. */
-unsigned
-frame_hash (const struct hash_elem *e, void *aux UNUSED)
+/* Waits for the evictions under way of the current thread's
+   frames, or only of its frame for UPAGE if UPAGE is not null.
+   An evictor marks the victim before unmapping it and holds the
+   victim's pin_sema until it has released the victim. */
+static void
+wait_evictions (const void *upage)
 {
-  const struct ft_entry *entry = hash_entry (e, struct ft_entry, elem);
-  uint64_t big_vaddr = ((uint64_t) 0 | entry->vaddr) << 32;
-  uint64_t identifier = (((uint64_t) 0 | entry->vaddr) << 32) | (uint32_t) entry->thread;
+	struct thread *cur = thread_current ();
+	size_t i;
 
-  return hash_bytes (&identifier, sizeof big_vaddr);
+	for (i = 0; i < frame_cnt; i++)
+		if (frames[i].thread == cur && frames[i].evicting
+		    && (upage == NULL || frames[i].vaddr == (uint32_t) upage))
+			{
+				sema_down (&frames[i].pin_sema);
+				sema_up (&frames[i].pin_sema);
+			}
 }
 
-/* Returns true if page a precedes page b. */
+/* Maps UPAGE in the current thread, read-only, to the frame in
+   the shared page cache holding the file page that starts at
+   SECTOR with READ_BYTES bytes from the file.  Returns false if no such frame is resident, or it is
+   being evicted. */
 bool
-frame_less_than (const struct hash_elem *elem_a, const struct hash_elem *elem_b, void *aux UNUSED)
+frame_share_map (block_sector_t sector, uint32_t read_bytes, void *upage)
+{
+	struct ft_entry key, *entry = NULL;
+	struct frame_map *map;
+	struct hash_elem *e;
+
+	map = malloc (sizeof *map);
+	if (map == NULL)
+		return false;
+	key.sector = sector;
+	key.read_bytes = read_bytes;
+	sema_down (&share_sema);
+	e = hash_find (&share_cache, &key.share_elem);
+	if (e != NULL)
+		{
+			entry = hash_entry (e, struct ft_entry, share_elem);
+			if (!sema_try_down (&entry->pin_sema))
+				entry = NULL;
+		}
+	sema_up (&share_sema);
+	if (entry == NULL)
+		{
+			free (map);
+			return false;
+		}
+
+	map->thread = thread_current ();
+	map->pagedir = map->thread->pagedir;
+	map->vaddr = upage;
+	list_push_back (&entry->sharers, &map->elem);
+	pagedir_set_page (map->thread->pagedir, upage, frame_kpage (entry), false);
+	share_hit_cnt++;
+	sema_up (&entry->pin_sema);
+	return true;
+}
+
+/* Enters pinned frame KPAGE, just loaded with the read-only file
+   page starting at SECTOR with READ_BYTES bytes from the file,
+   into the shared page cache.  Does
+   nothing if another frame already holds that page. */
+void
+frame_share_add (void *kpage, block_sector_t sector, uint32_t read_bytes)
+{
+	struct ft_entry *entry = frame_lookup (kpage);
+
+	ASSERT (!entry->shared);
+	entry->sector = sector;
+	entry->read_bytes = read_bytes;
+	sema_down (&share_sema);
+	entry->shared = hash_insert (&share_cache, &entry->share_elem) == NULL;
+	sema_up (&share_sema);
+}
+
+/* Pins user frame KPAGE if SET is true, so that it cannot be
+   evicted, or unpins it if SET is false.  The shared zero frame
+   is never evicted, so pinning it does nothing. */
+void
+set_pinned (void *kpage, bool set)
 {
-  struct ft_entry *entry_a = hash_entry (elem_a, struct ft_entry, elem);
-  struct ft_entry *entry_b = hash_entry (elem_b, struct ft_entry, elem);
+	struct ft_entry *pin_entry;
+	if (kpage == zero_frame)
+		return;
+	pin_entry = frame_lookup (kpage);
+	if (set)
+		sema_down (&pin_entry->pin_sema);
+	else
+		{
+			sema_try_down (&pin_entry->pin_sema);
+			sema_up (&pin_entry->pin_sema);
+		}
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+	printf ("Frame table: %llu evictions (%llu by pageout), "
+	        "%llu second chances\n",
+	        evict_cnt, pageout_cnt, second_chance_cnt);
+	printf ("Frame table: %llu pages read ahead from swap or file, %llu used, "
+	        "%llu evicted unused\n",
+	        readahead_cnt, readahead_hit_cnt, readahead_miss_cnt);
+	printf ("Frame table: %llu dirty victims written to swap, "
+	        "%llu clean victims dropped (%llu file, %llu swap, %llu zero)\n",
+	        dirty_victim_cnt, clean_file_cnt + clean_swap_cnt + clean_zero_cnt,
+	        clean_file_cnt, clean_swap_cnt, clean_zero_cnt);
+	printf ("Frame table: %llu faults served from shared pages, "
+	        "%llu dirty mapped victims written back to file\n",
+	        share_hit_cnt, mmap_victim_cnt);
+}
+
+/* Returns the frame table entry for user frame KPAGE in constant
+   time, using KPAGE's index within the user pool. */
+static struct ft_entry *
+frame_lookup (const void *kpage)
+{
+	return &frames[palloc_user_page_idx (kpage)];
+}
+
+/* Returns the kernel address of the frame for ENTRY. */
+static void *
+frame_kpage (const struct ft_entry *entry)
+{
+	return palloc_user_page_addr (entry - frames);
+}
+
+/* Returns true if any process mapping pinned frame ENTRY has
+   accessed it since the last call, clearing every mapping's
+   accessed bit.  Must be called with ft_sema held, while the
+   owner has not closed its frames. */
+static bool
+frame_test_accessed (struct ft_entry *entry)
+{
+	struct thread *owner = entry->thread;
+	struct list_elem *e;
+	bool accessed = false;
+
+	if (pagedir_is_accessed (owner->pagedir, (void *) entry->vaddr))
+		{
+			pagedir_set_accessed (owner->pagedir, (void *) entry->vaddr, false);
+			accessed = true;
+		}
+	for (e = list_begin (&entry->sharers); e != list_end (&entry->sharers);
+	     e = list_next (e))
+		{
+			struct frame_map *map = list_entry (e, struct frame_map, elem);
+			if (pagedir_is_accessed (map->pagedir, map->vaddr))
+				{
+					pagedir_set_accessed (map->pagedir, map->vaddr, false);
+					accessed = true;
+				}
+		}
+	return accessed;
+}
 
-  return (entry_a->vaddr < entry_b->vaddr) && ((uint32_t) entry_a->thread < (uint32_t) entry_b->thread);
+/* Removes pinned frame ENTRY from the shared page cache and
+   unmaps it from every process sharing it other than its owner. */
+static void
+frame_unshare (struct ft_entry *entry)
+{
+	if (entry->shared)
+		{
+			sema_down (&share_sema);
+			hash_delete (&share_cache, &entry->share_elem);
+			sema_up (&share_sema);
+			entry->shared = false;
+		}
+	while (!list_empty (&entry->sharers))
+		{
+			struct frame_map *map = list_entry (list_pop_front (&entry->sharers),
+			                                    struct frame_map, elem);
+			pagedir_clear_page (map->pagedir, map->vaddr);
+			free (map);
+		}
+}
+
+/* Hash function for the shared page cache. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct ft_entry *entry = hash_entry (e, struct ft_entry, share_elem);
+	return hash_int (entry->sector) ^ hash_int (entry->read_bytes);
+}
+
+/* Orders shared page cache entries by sector, then by bytes read. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+	const struct ft_entry *a = hash_entry (a_, struct ft_entry, share_elem);
+	const struct ft_entry *b = hash_entry (b_, struct ft_entry, share_elem);
+	if (a->sector != b->sector)
+		return a->sector < b->sector;
+	return a->read_bytes < b->read_bytes;
 }
@@ -4,21 +4,37 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <hash.h>
+#include <list.h>
+#include "devices/block.h"
 #include "threads/synch.h"
 
+/* One entry per frame in the user pool, indexed by the frame's
+   position in the pool. */
 struct ft_entry
 {
-	struct hash_elem elem;
-	struct thread *thread;
-	uint32_t vaddr;
-	struct semaphore pin_sema;
+	struct thread *thread;        /* Owning thread, NULL if frame is free. */
+	uint32_t vaddr;               /* User page mapped to this frame. */
+	struct semaphore pin_sema;    /* Guards the entry; 0 while pinned. */
+	bool prefetched;              /* Read ahead and not yet seen accessed. */
+	bool evicting;                /* Victim whose owner's tables are in use. */
+	bool shared;                  /* In the shared page cache? */
+	block_sector_t sector;        /* Shared page cache key: first sector... */
+	uint32_t read_bytes;          /* ...and bytes read from the file. */
+	struct hash_elem share_elem;  /* Shared page cache element. */
+	struct list sharers;          /* Other processes mapping the frame. */
 };
 
 void frame_table_init (void);
 void *get_user_page (uint8_t *vaddr);
-void frame_table_destroy (void);
+void *get_readahead_page (uint8_t *vaddr);
 void *evict_page (uint8_t *new_addr);
-void free_frame (void *vaddr);
-void set_pinned (void *vaddr, bool set);
+void *frame_zero_page (void);
+bool frame_share_map (block_sector_t sector, uint32_t read_bytes, void *upage);
+void frame_share_add (void *kpage, block_sector_t sector, uint32_t read_bytes);
+void free_frame (void *kpage);
+void frame_owner_exit (void);
+void frame_wait_eviction (const void *upage);
+void set_pinned (void *kpage, bool set);
+void frame_print_stats (void);
 
 #endif /* vm/frame.h */
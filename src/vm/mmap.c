@@ -0,0 +1,153 @@
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/frame.h"
+#include <debug.h>
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+static void region_unmap (struct mmap_region *);
+
+/* Maps FILE, an open file of the current process, at user
+   address ADDR.  Nothing is read until the pages are touched.
+   Fails and returns MAP_FAILED if FILE is empty, ADDR is null or
+   not page-aligned, or any page of the mapping would overlap a
+   page the process already has. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mmap_region *r;
+  off_t length;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return MAP_FAILED;
+  r->addr = addr;
+  r->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      uint8_t *upage = r->addr + i * PGSIZE;
+      if (!is_user_vaddr (upage)
+          || lookup_sup_page (t->supdir, upage) != NULL
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        {
+          free (r);
+          return MAP_FAILED;
+        }
+    }
+
+  /* Keep a reopening, so that the mapping outlives FILE being
+     closed or removed. */
+  r->file = file_reopen (file);
+  if (r->file == NULL)
+    {
+      free (r);
+      return MAP_FAILED;
+    }
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      if (!supdir_set_file (t->supdir, r->addr + ofs, r->file, ofs,
+                            read_bytes, MMAP_SYS, true))
+        {
+          r->page_cnt = i;
+          region_unmap (r);
+          return MAP_FAILED;
+        }
+    }
+
+  r->id = t->next_mapid++;
+  list_push_back (&t->mmaps, &r->elem);
+  return r->id;
+}
+
+/* Unmaps the current process's mapping ID, writing its dirty
+   pages back to the file.  Returns false if there is no such
+   mapping. */
+bool
+mmap_unmap (mapid_t id)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mmaps); e != list_end (&t->mmaps); e = list_next (e))
+    {
+      struct mmap_region *r = list_entry (e, struct mmap_region, elem);
+      if (r->id == id)
+        {
+          list_remove (&r->elem);
+          region_unmap (r);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Unmaps all of the current process's mappings.  Called on
+   process exit, while the page tables still record which pages
+   are dirty. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mmaps))
+    region_unmap (list_entry (list_pop_front (&t->mmaps),
+                              struct mmap_region, elem));
+}
+
+/* Writes back and unmaps each page of R, which must already be
+   off the thread's mmaps list, then frees R. */
+static void
+region_unmap (struct mmap_region *r)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      uint8_t *upage = r->addr + i * PGSIZE;
+      struct spte *entry = lookup_sup_page (t->supdir, upage);
+      void *kpage = pagedir_get_page (t->pagedir, upage);
+
+      if (kpage != NULL)
+        {
+          /* Pinning waits out an eviction in progress, after
+             which the page may no longer be ours. */
+          set_pinned (kpage, true);
+          if (pagedir_get_page (t->pagedir, upage) == kpage
+              && pagedir_is_dirty (t->pagedir, upage))
+            {
+              page_write_back (entry, kpage);
+              pagedir_set_dirty (t->pagedir, upage, false);
+            }
+          set_pinned (kpage, false);
+          free_frame (kpage);
+          pagedir_clear_page (t->pagedir, upage);
+        }
+      else
+        {
+          /* An eviction may have unmapped the page and still be
+             writing it back through ENTRY and R's file.  Once it
+             is done, the data is back in the file. */
+          frame_wait_eviction (upage);
+        }
+      supdir_clear_page (t->supdir, upage);
+    }
+
+  file_close (r->file);
+  free (r);
+}
@@ -0,0 +1,29 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <list.h>
+#include "filesys/file.h"
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A file mapped into a process's address space.  Its pages are
+   MMAP_SYS entries in the supplemental page table, loaded on
+   demand and written back to the file when dirty. */
+struct mmap_region
+{
+  mapid_t id;                   /* Identifier returned by mmap. */
+  struct file *file;            /* Private reopening of the file. */
+  uint8_t *addr;                /* First mapped page. */
+  size_t page_cnt;              /* Number of mapped pages. */
+  struct list_elem elem;        /* Element in thread's mmaps list. */
+};
+
+mapid_t mmap_map (struct file *file, void *addr);
+bool mmap_unmap (mapid_t id);
+void mmap_unmap_all (void);
+
+#endif /* vm/mmap.h */
@@ -10,8 +10,24 @@
 #include "devices/block.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
 #include "filesys/filesys.h"
 #include "userprog/pagedir.h"
+#include "userprog/exception.h"
+
+/* Number of following pages read ahead from swap on a swap-in,
+   set by the kernel command-line option "-swap-ra". */
+size_t swap_readahead_pages = 4;
+
+/* Size in pages of the aligned window of file pages mapped
+   around a faulting file page, set by the kernel command-line
+   option "-fault-around".  0 or 1 turns fault-around off. */
+size_t fault_around_pages = 8;
+
+static void swap_readahead (void *vpage, block_sector_t sector);
+static unsigned hash (const struct hash_elem *e, void *aux);
+static bool less_than (const struct hash_elem *elem_a, const struct hash_elem *elem_b, void *aux);
 
 struct hash *
 supdir_create (void) 
@@ -33,8 +49,9 @@ supdir_destroy (struct hash *table)
   while (e != NULL)
     {
       struct spte *entry = hash_entry (e, struct spte, elem);
-      uint32_t *pte = lookup_page (thread_current ()->pagedir, (const void *) entry->vaddr, false);
-      if ((pte != NULL) && !(*pte & PTE_P) && (entry->location == SWAP_SYS))
+      /* Swapped-in pages keep their slot, so free it whether or
+         not the page is resident. */
+      if (entry->location == SWAP_SYS)
         swap_remove (entry->sector);
       e = hash_next (&iterator);
     }
@@ -69,10 +86,31 @@ supdir_set_page (struct hash *table, void *vaddr, block_sector_t sector, size_t
   entry->read_bytes = read_bytes;
   entry->location = location;
   entry->writable = writable;
+  entry->file = NULL;
+  entry->ofs = 0;
   hash_replace (table, &entry->elem);
   return true;
 }
 
+/* Records VADDR as a page of TABLE loaded with READ_BYTES bytes
+   from FILE at offset OFS.  The page's first sector on disk is
+   kept too, as the shared page cache key and to spot runs of
+   pages that lie together on disk; it is -1 if the page starts
+   in a hole. */
+bool
+supdir_set_file (struct hash *table, void *vaddr, struct file *file, off_t ofs, size_t read_bytes, uint8_t location, bool writable)
+{
+  struct spte *entry;
+
+  if (!supdir_set_page (table, vaddr, byte_to_sector (file_get_inode (file), ofs),
+                        read_bytes, location, writable))
+    return false;
+  entry = lookup_sup_page (table, vaddr);
+  entry->file = file;
+  entry->ofs = ofs;
+  return true;
+}
+
 bool
 supdir_set_swap (struct hash *supdir, void *vaddr, block_sector_t swap_sector)
 {
@@ -111,39 +149,226 @@ load_page (void *vpage, void *frame)
   if (entry != NULL)
     {
       uint8_t location = entry->location;
-      int32_t read_bytes = entry->read_bytes;
-      uint32_t zero_bytes = PGSIZE - read_bytes;
       block_sector_t sector = entry->sector;
-      void *frame_ = frame;
-      if (location == FILE_SYS)
-        {
-          while (read_bytes > 0)
-            {
-              block_read (fs_device, sector, frame_);
-              sector++;
-              if (read_bytes >= BLOCK_SECTOR_SIZE)
-                frame_ += BLOCK_SECTOR_SIZE;
-              else
-                frame_ += read_bytes;
-              read_bytes -= BLOCK_SECTOR_SIZE;
-            }
-        }
+      off_t filled = 0;
+      if (location == FILE_SYS || location == MMAP_SYS)
+        filled = file_read_at (entry->file, frame, entry->read_bytes, entry->ofs);
       else if (location == SWAP_SYS)
         {
           swap_read (sector, frame);
+          swap_readahead (vpage, sector);
+          filled = PGSIZE;
         }
-      if (zero_bytes > 0)
-        memset (frame_, 0, zero_bytes);
+      if (filled < PGSIZE)
+        memset ((uint8_t *) frame + filled, 0, PGSIZE - filled);
       bool writable = entry->writable;
       pagedir_set_page (thread_current ()->pagedir, (void *) vpage, (void *) frame, writable);
+      if (location == FILE_SYS && !writable && sector != (block_sector_t) -1)
+        frame_share_add (frame, entry->sector, entry->read_bytes);
       return true;
     }
   else
     return false;
 }
 
+/* Writes FRAME, holding the memory-mapped file page described by
+   ENTRY, back to its file.  Only the part of the page that lies
+   within the file is written. */
+void
+page_write_back (const struct spte *entry, const void *frame)
+{
+  ASSERT (entry->location == MMAP_SYS);
+  file_write_at (entry->file, frame, entry->read_bytes, entry->ofs);
+}
+
+/* Maps the shared zero frame read-only at VPAGE, if VPAGE is a
+   demand-zero page of the current process, so that reading it
+   costs no frame.  Returns false if VPAGE is not demand-zero. */
+bool
+load_zero_page (void *vpage)
+{
+  struct thread *t = thread_current ();
+  struct spte *entry = lookup_sup_page (t->supdir, vpage);
+  if (entry == NULL || entry->location != ZERO_SYS)
+    return false;
+  return pagedir_set_page (t->pagedir, vpage, frame_zero_page (), false);
+}
+
+/* Maps VPAGE, if it is a read-only file page of the current
+   process, to a frame already holding the same page for another
+   process.  Returns false if VPAGE is not such a page or no such
+   frame is resident. */
+bool
+load_shared_page (void *vpage)
+{
+  struct spte *entry = lookup_sup_page (thread_current ()->supdir, vpage);
+  if (entry == NULL || entry->location != FILE_SYS || entry->writable
+      || entry->sector == (block_sector_t) -1)
+    return false;
+  return frame_share_map (entry->sector, entry->read_bytes, vpage);
+}
+
+/* Gives VPAGE a private zeroed frame, writable, if it is a
+   writable page of the current process that still maps the
+   shared zero frame.  Returns false if VPAGE does not map the
+   zero frame, is read-only, or no frame could be had. */
+bool
+page_unshare_zero (void *vpage)
+{
+  struct thread *t = thread_current ();
+  struct spte *entry = lookup_sup_page (t->supdir, vpage);
+  void *frame;
+
+  if (entry == NULL || !entry->writable
+      || pagedir_get_page (t->pagedir, vpage) != frame_zero_page ())
+    return false;
+  frame = get_user_page (vpage);
+  if (frame == NULL && (frame = evict_page (vpage)) == NULL)
+    return false;
+  memset (frame, 0, PGSIZE);
+  pagedir_clear_page (t->pagedir, vpage);
+  pagedir_set_page (t->pagedir, vpage, frame, true);
+  set_pinned (frame, false);
+  return true;
+}
+
+/* Maps the other not-yet-present pages of the fault_around_pages
+   window around VPAGE, a file page of the current process that
+   has just been faulted in, so that the rest of a segment does
+   not take one fault per page.  Only neighbours that continue
+   VPAGE's run of sectors with the same writability are mapped,
+   which keeps the window within VPAGE's segment, and only frames
+   that are free to spare are used. */
+void
+page_fault_around (void *vpage)
+{
+  struct thread *t = thread_current ();
+  struct spte *fault = lookup_sup_page (t->supdir, vpage);
+  uint8_t *start, *upage;
+
+  if (fault_around_pages <= 1 || fault == NULL || fault->location != FILE_SYS
+      || fault->sector == (block_sector_t) -1)
+    return;
+  start = (uint8_t *) vpage - pg_no (vpage) % fault_around_pages * PGSIZE;
+  for (upage = start; upage < start + fault_around_pages * PGSIZE; upage += PGSIZE)
+    {
+      int sector_ofs = (upage - (uint8_t *) vpage) / BLOCK_SECTOR_SIZE;
+      struct spte *entry;
+      void *frame;
+
+      if (upage == vpage || !is_user_vaddr (upage)
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        continue;
+      entry = lookup_sup_page (t->supdir, upage);
+      if (entry == NULL || entry->location != FILE_SYS
+          || entry->writable != fault->writable
+          || entry->sector != fault->sector + sector_ofs)
+        continue;
+      if (load_shared_page (upage))
+        continue;
+      frame = get_readahead_page (upage);
+      if (frame == NULL)
+        break;
+      load_page (upage, frame);
+      set_pinned (frame, false);
+    }
+}
+
+/* Faults in and pins every page of the current process spanned
+   by the SIZE bytes at UADDR, so that the kernel can transfer
+   to or from them, for instance while holding file system locks,
+   without taking a page fault.  If WRITE is true the pages are
+   also given private frames if they still map the zero frame.
+   The range must already have been validated, and must later be
+   released with page_unpin_range. */
+void
+page_pin_range (const void *uaddr, size_t size, bool write)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage;
+
+  for (upage = pg_round_down (uaddr); upage < (const uint8_t *) uaddr + size;
+       upage += PGSIZE)
+    for (;;)
+      {
+        void *kpage = pagedir_get_page (t->pagedir, upage);
+        if (kpage == NULL)
+          {
+            /* Evicted since it was validated.  A validated page
+               with no supplemental entry is a stack page. */
+            page_in (upage, NULL, true, write);
+            continue;
+          }
+        if (write && page_unshare_zero (upage))
+          continue;
+
+        /* Pinning waits out an eviction in progress, which leaves
+           the page unmapped again. */
+        set_pinned (kpage, true);
+        if (pagedir_get_page (t->pagedir, upage) == kpage)
+          break;
+        set_pinned (kpage, false);
+      }
+}
+
+/* Unpins the pages spanned by the SIZE bytes at UADDR, pinned
+   by page_pin_range. */
+void
+page_unpin_range (const void *uaddr, size_t size)
+{
+  struct thread *t = thread_current ();
+  uint8_t *upage;
+
+  for (upage = pg_round_down (uaddr); upage < (const uint8_t *) uaddr + size;
+       upage += PGSIZE)
+    set_pinned (pagedir_get_page (t->pagedir, upage), false);
+}
+
+/* Reads ahead up to swap_readahead_pages pages following VPAGE
+   in the current process, stopping at the first one that is not
+   swapped out in the slot right after its predecessor's, so that
+   the whole window comes in with one disk transfer.  Only frames
+   that are free to spare are used. */
+static void
+swap_readahead (void *vpage, block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+  void *upages[SWAP_BATCH_MAX];
+  void *frames[SWAP_BATCH_MAX];
+  bool writable[SWAP_BATCH_MAX];
+  size_t cnt, i;
+
+  for (cnt = 0; cnt < swap_readahead_pages && cnt < SWAP_BATCH_MAX; cnt++)
+    {
+      void *upage = (uint8_t *) vpage + (cnt + 1) * PGSIZE;
+      struct spte *entry;
+
+      if (!is_user_vaddr (upage))
+        break;
+      entry = lookup_sup_page (t->supdir, upage);
+      if (entry == NULL || entry->location != SWAP_SYS
+          || entry->sector != sector + (cnt + 1) * SECTORS_PER_SLOT
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        break;
+      frames[cnt] = get_readahead_page (upage);
+      if (frames[cnt] == NULL)
+        break;
+      upages[cnt] = upage;
+      writable[cnt] = entry->writable;
+    }
+  if (cnt == 0)
+    return;
+
+  swap_read_run (sector + SECTORS_PER_SLOT, frames, cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      pagedir_set_page (t->pagedir, upages[i], frames[i], writable[i]);
+      set_pinned (frames[i], false);
+    }
+}
+
 /* Returns a hash value for entry e. */
-unsigned
+static unsigned
 hash (const struct hash_elem *e, void *aux UNUSED)
 {
   const struct spte *entry = hash_entry (e, struct spte, elem);
@@ -151,7 +376,7 @@ hash (const struct hash_elem *e, void *aux UNUSED)
 }
 
 /* Returns true if page a precedes page b. */
-bool
+static bool
 less_than (const struct hash_elem *elem_a, const struct hash_elem *elem_b, void *aux UNUSED)
 {
   const struct spte *entry_a = hash_entry (elem_a, struct spte, elem);
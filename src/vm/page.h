@@ -4,8 +4,12 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 #include <hash.h>
 
+struct file;
+
+#define MMAP_SYS 4
 #define FILE_SYS 3
 #define SWAP_SYS 2
 #define MEM_SYS	 1
@@ -18,18 +22,36 @@ struct spte
 	block_sector_t sector;
 	uint32_t read_bytes;
 	uint32_t vaddr;
+	struct file *file;	/* File and offset that FILE_SYS and */
+	off_t ofs;		/* MMAP_SYS pages load from. */
 	struct hash_elem elem;
 };
 
+/* Most pages to read ahead after a fault on a swapped-out page. */
+extern size_t swap_readahead_pages;
+
+/* Pages in the fault-around window for file page faults, at
+   most FAULT_AROUND_MAX. */
+#define FAULT_AROUND_MAX 32
+extern size_t fault_around_pages;
+
 struct hash *supdir_create (void);
 void supdir_destroy (struct hash *table);
 bool sup_page_free (void);
 struct spte *lookup_sup_page (struct hash *table, const void *vaddr);
 bool supdir_set_page (struct hash *table, void *vaddr, block_sector_t sector, size_t read_bytes, uint8_t location, bool writable);
+bool supdir_set_file (struct hash *table, void *vaddr, struct file *file, off_t ofs, size_t read_bytes, uint8_t location, bool writable);
 block_sector_t supdir_get_sector (struct hash *table, const void *vaddr);
 void supdir_clear_page (struct hash *table, void *upage);
 bool load_page (void *vpage, void *frame);
 bool load_stack_pg (void *vpage, void *frame);
+void page_write_back (const struct spte *entry, const void *frame);
+bool load_zero_page (void *vpage);
+bool load_shared_page (void *vpage);
+void page_fault_around (void *vpage);
+void page_pin_range (const void *uaddr, size_t size, bool write);
+void page_unpin_range (const void *uaddr, size_t size);
+bool page_unshare_zero (void *vpage);
 bool supdir_set_swap (struct hash *supdir, void *vaddr, block_sector_t swap_sector);
 
 #endif /* vm/page.h */
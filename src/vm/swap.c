@@ -2,76 +2,238 @@
 #include "devices/block.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include <debug.h>
 #include <stdio.h>
 #include <string.h>
 
-struct bitmap *swap_table;
 struct block *swap_device;
 struct semaphore *swap_sema;
 
+/* Swap slots.  Slot N covers sectors N * SECTORS_PER_SLOT through
+   N * SECTORS_PER_SLOT + SECTORS_PER_SLOT - 1 of the swap device.
+   Each slot holds the page of at most one address space. */
+static size_t slot_cnt;
+static bool *slot_used;
+
+/* Stack of free slot numbers, so that allocating and freeing a
+   slot take constant time. */
+static size_t *free_slots;
+static size_t free_top;
+
+/* Statistics. */
+static size_t peak_used;                    /* Most slots in use at once. */
+static unsigned long long pages_written;    /* Pages written to swap. */
+static unsigned long long write_xfer_cnt;   /* Disk requests they took. */
+static unsigned long long pages_read;       /* Pages read from swap. */
+
+static size_t slot_alloc (void);
+static void slot_io (size_t slot, size_t cnt, void *const frames[],
+                     bool write);
+
 bool
 swap_init ()
 {
 	/* Scott was driving */
+	size_t slot;
+
 	swap_device = block_get_role (BLOCK_SWAP);
-	if ((swap_table = bitmap_create ((size_t) block_size (swap_device))))
+	slot_cnt = swap_device != NULL ? block_size (swap_device) / SECTORS_PER_SLOT : 0;
+	slot_used = calloc (slot_cnt, sizeof *slot_used);
+	free_slots = malloc (slot_cnt * sizeof *free_slots);
+	if (slot_cnt > 0 && (slot_used == NULL || free_slots == NULL))
 		{
-			swap_sema = malloc (sizeof (struct semaphore));
-			sema_init (swap_sema, 1);
-			return true;
+			free (slot_used);
+			free (free_slots);
+			slot_cnt = 0;
+			return false;
 		}
-	return false; 
+
+	/* Push in reverse so that low slots are handed out first. */
+	free_top = 0;
+	for (slot = slot_cnt; slot > 0; slot--)
+		free_slots[free_top++] = slot - 1;
+
+	swap_sema = malloc (sizeof (struct semaphore));
+	sema_init (swap_sema, 1);
+	return true;
 }
 
-void
-swap_destroy ()
+/* Writes the page at FRAME_ADDR to a newly allocated swap slot
+   and returns the slot's first sector, or SWAP_ERROR if swap is
+   full. */
+size_t
+swap_write (void *frame_addr)
 {
-	sema_down (swap_sema);
-	bitmap_destroy (swap_table);
-	sema_up (swap_sema);
+	size_t slot = slot_alloc ();
+	if (slot == SWAP_ERROR)
+		return SWAP_ERROR;
+	slot_io (slot, 1, &frame_addr, true);
+	return slot * SECTORS_PER_SLOT;
 }
 
+/* Writes the CNT pages in FRAMES, at most SWAP_BATCH_MAX, to newly
+   allocated swap slots and stores the first sector of the Nth
+   page's slot into SECTORS[N].  Pages that land in adjacent slots
+   go to disk as one multi-sector transfer.  If swap fills up, the
+   pages that did not fit get SWAP_ERROR.  Returns the number of
+   pages written. */
 size_t
-swap_write (void *frame_addr)
+swap_write_batch (void *frames[], size_t cnt, size_t sectors[])
 {
-	int write_sector;
-	sema_down (swap_sema);
-	size_t index = bitmap_scan_and_flip (swap_table, 0, 8, false);
-	sema_up (swap_sema);
-	size_t ret = index;
-	if (index != BITMAP_ERROR)
+	size_t slots[SWAP_BATCH_MAX];
+	void *sorted[SWAP_BATCH_MAX];
+	size_t i, j, written = 0;
+
+	ASSERT (cnt <= SWAP_BATCH_MAX);
+
+	/* Allocate slots and sort them, with their pages, by slot. */
+	for (i = 0; i < cnt; i++)
 		{
-			for (write_sector = 0; write_sector < 8; write_sector++)
+			size_t slot = slot_alloc ();
+			sectors[i] = slot == SWAP_ERROR ? SWAP_ERROR : slot * SECTORS_PER_SLOT;
+			if (slot == SWAP_ERROR)
+				continue;
+			for (j = written; j > 0 && slots[j - 1] > slot; j--)
 				{
-					block_write (swap_device, (block_sector_t) index, frame_addr);
-				  index++;
-				  frame_addr += BLOCK_SECTOR_SIZE; 
+					slots[j] = slots[j - 1];
+					sorted[j] = sorted[j - 1];
 				}
+			slots[j] = slot;
+			sorted[j] = frames[i];
+			written++;
 		}
-	return ret;
+
+	/* Write each run of consecutive slots with one request. */
+	for (i = 0; i < written; i = j)
+		{
+			for (j = i + 1; j < written && slots[j] == slots[j - 1] + 1; j++)
+				continue;
+			slot_io (slots[i], j - i, &sorted[i], true);
+		}
+	return written;
+}
+
+/* Writes the page at FRAME_ADDR back to the swap slot at SECTOR,
+   which it was read from, reusing the slot in place. */
+void
+swap_rewrite (size_t sector, void *frame_addr)
+{
+	size_t slot = sector / SECTORS_PER_SLOT;
+
+	ASSERT (slot < slot_cnt && slot_used[slot]);
+	slot_io (slot, 1, &frame_addr, true);
 }
 
 void
 swap_read (size_t sector, void *frame_addr)
 {
 	/* Heather was driving */
-	int write_sector;
+	/* The slot stays allocated, so that if the page is evicted
+	   again while still clean it need not be written. */
+	ASSERT (sector / SECTORS_PER_SLOT < slot_cnt);
+	slot_io (sector / SECTORS_PER_SLOT, 1, &frame_addr, false);
+}
+
+/* Reads the CNT pages, at most SWAP_BATCH_MAX, held in the
+   consecutive swap slots starting at SECTOR into FRAMES, with a
+   single disk transfer.  Like swap_read, leaves the slots
+   allocated. */
+void
+swap_read_run (size_t sector, void *frames[], size_t cnt)
+{
+	ASSERT ((sector / SECTORS_PER_SLOT) + cnt <= slot_cnt);
+	slot_io (sector / SECTORS_PER_SLOT, cnt, frames, false);
+}
+
+/* Frees the swap slot at SECTOR.  Used on process
+   termination. */
+void
+swap_remove (size_t sector)
+{
+	size_t slot = sector / SECTORS_PER_SLOT;
+
+	ASSERT (slot < slot_cnt);
 	sema_down (swap_sema);
-	bitmap_mark (swap_table, sector);
+	ASSERT (slot_used[slot]);
+	slot_used[slot] = false;
+	free_slots[free_top++] = slot;
 	sema_up (swap_sema);
-	for (write_sector = 0; write_sector < 8; write_sector++)
+}
+
+/* Prints swap statistics: slot occupancy, and fragmentation as
+   the number of separate runs the free slots are split into. */
+void
+swap_print_stats (void)
+{
+	size_t slot, free_runs = 0;
+	bool in_run = false;
+
+	sema_down (swap_sema);
+	for (slot = 0; slot < slot_cnt; slot++)
 		{
-			block_read (swap_device, (block_sector_t) sector, frame_addr);
-		  sector++;
-		  frame_addr += BLOCK_SECTOR_SIZE; 
+			if (!slot_used[slot] && !in_run)
+				free_runs++;
+			in_run = !slot_used[slot];
 		}
+	printf ("Swap: %zu of %zu slots in use (peak %zu), "
+	        "%zu free slots in %zu runs\n",
+	        slot_cnt - free_top, slot_cnt, peak_used,
+	        free_top, free_runs);
+	printf ("Swap: %llu pages written in %llu transfers, %llu pages read\n",
+	        pages_written, write_xfer_cnt, pages_read);
+	sema_up (swap_sema);
 }
 
-/* Used on process termination */
-void
-swap_remove (size_t sector)
+/* Pops a free slot off the stack and marks it in use.  Returns
+   SWAP_ERROR if no slot is free. */
+static size_t
+slot_alloc (void)
+{
+	size_t slot = SWAP_ERROR;
+
+	sema_down (swap_sema);
+	if (free_top > 0)
+		{
+			slot = free_slots[--free_top];
+			slot_used[slot] = true;
+			if (slot_cnt - free_top > peak_used)
+				peak_used = slot_cnt - free_top;
+		}
+	sema_up (swap_sema);
+	return slot;
+}
+
+/* Reads or writes the CNT pages in FRAMES from or to the CNT
+   consecutive swap slots starting at SLOT, according to WRITE,
+   as a single block request. */
+static void
+slot_io (size_t slot, size_t cnt, void *const frames[], bool write)
 {
+	void *sectors[SWAP_BATCH_MAX * SECTORS_PER_SLOT];
+	size_t i;
+
+	ASSERT (cnt <= SWAP_BATCH_MAX);
+	for (i = 0; i < cnt * SECTORS_PER_SLOT; i++)
+		sectors[i] = (uint8_t *) frames[i / SECTORS_PER_SLOT]
+		             + i % SECTORS_PER_SLOT * BLOCK_SECTOR_SIZE;
+
+	if (write)
+		block_write_multiple (swap_device, slot * SECTORS_PER_SLOT,
+		                      cnt * SECTORS_PER_SLOT, sectors);
+	else
+		block_read_multiple (swap_device, slot * SECTORS_PER_SLOT,
+		                     cnt * SECTORS_PER_SLOT, sectors);
+
+	/* Pageout and faulting threads do I/O at once, so the counts
+	   are kept under swap_sema, as swap_print_stats reads them. */
 	sema_down (swap_sema);
-	bitmap_reset (swap_table, sector);
+	if (write)
+		{
+			pages_written += cnt;
+			write_xfer_cnt++;
+		}
+	else
+		pages_read += cnt;
 	sema_up (swap_sema);
 }
@@ -3,13 +3,26 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <bitmap.h>
 #include <stddef.h>
+#include "devices/block.h"
+#include "threads/vaddr.h"
+
+/* Returned by swap_write when swap is full. */
+#define SWAP_ERROR SIZE_MAX
+
+/* Number of sectors in one swap slot, which holds one page. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most pages swap_write_batch and swap_read_run take at once. */
+#define SWAP_BATCH_MAX 8
 
 bool swap_init (void);
-void swap_destroy (void);
 size_t swap_write (void *frame_addr);
+size_t swap_write_batch (void *frames[], size_t cnt, size_t sectors[]);
+void swap_rewrite (size_t sector, void *frame_addr);
 void swap_read (size_t sector, void *frame_addr);
+void swap_read_run (size_t sector, void *frames[], size_t cnt);
 void swap_remove (size_t sector);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */